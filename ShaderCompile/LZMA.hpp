@@ -24,176 +24,111 @@ namespace LZMA
 	}
 	static ISzAlloc g_Alloc = { SzAlloc, SzFree };
 
-	static inline SRes LzmaEncode( const Byte* inBuffer, size_t inSize, Byte* outBuffer, size_t outSize, size_t* outSizeProcessed )
+	// Encoder kept by each thread and reused for every block it compresses. Blocks are
+	// at most MAX_SHADER_UNPACKED_BLOCK_SIZE, the dictionary is clamped to the input so
+	// the match finder stays small and its tables are only allocated once.
+	class CEncoder
 	{
-		class CInStreamRam : public ISeqInStream
+	public:
+		CEncoder() noexcept : m_hEnc( LzmaEnc_Create( &g_Alloc ) ) {}
+		~CEncoder()
 		{
-			const Byte* Data;
-			size_t Size;
-			size_t Pos;
-
-			SRes DoRead( void* buf, size_t* size )
-			{
-				size_t inSize = *size;
-				size_t remain = Size - Pos;
-				if ( inSize > remain )
-					inSize = remain;
-
-				for ( size_t i = 0; i < inSize; ++i )
-					reinterpret_cast<Byte*>( buf )[i] = Data[Pos + i];
-
-				Pos += inSize;
-				*size = inSize;
-				return SZ_OK;
-			}
-
-			static SRes StaticRead( void* p, void* buf, size_t* size )
-			{
-				return reinterpret_cast<CInStreamRam*>( p )->DoRead( buf, size );
-			}
-
-		public:
-			CInStreamRam( const Byte* data, size_t size )
-			{
-				Data = data;
-				Size = size;
-				Pos = 0;
-				Read = StaticRead;
-			}
-		};
-
-		class COutStreamRam : public ISeqOutStream
+			if ( m_hEnc )
+				LzmaEnc_Destroy( m_hEnc, &g_Alloc, &g_Alloc );
+		}
+
+		CEncoder( const CEncoder& ) = delete;
+		CEncoder& operator=( const CEncoder& ) = delete;
+
+		static CEncoder& ForThread()
 		{
-			size_t Size;
-
-			static size_t StaticWrite( void* p, const void* buf, size_t size )
-			{
-				return reinterpret_cast<COutStreamRam*>( p )->DoWrite( buf, size );
-			}
-
-		public:
-			Byte* Data;
-			size_t Pos;
-			bool Overflow;
-
-			COutStreamRam( Byte* data, size_t size )
-			{
-				Data = data;
-				Size = size;
-				Pos = 0;
-				Overflow = false;
-				Write = StaticWrite;
-			}
-
-			size_t DoWrite( const void* buf, size_t size )
-			{
-				size_t i;
-				for ( i = 0; i < size && Pos < Size; ++i )
-					Data[Pos++] = reinterpret_cast<const Byte*>( buf )[i];
-				if ( i != size )
-					Overflow = true;
-				return i;
-			}
-		};
-
-		// Based on Encode helper in SDK/LzmaUtil
-		*outSizeProcessed = 0;
-
-		const size_t kMinDestSize = 13;
-		if ( outSize < kMinDestSize )
-			return SZ_ERROR_FAIL;
-
-		CLzmaEncHandle enc;
-		SRes res;
-		CLzmaEncProps props;
-
-		enc = LzmaEnc_Create( &g_Alloc );
-		if ( !enc )
-			return SZ_ERROR_FAIL;
-
-		LzmaEncProps_Init( &props );
-		res = LzmaEnc_SetProps( enc, &props );
-
-		if ( res != SZ_OK )
-			return res;
+			static thread_local CEncoder s_Encoder;
+			return s_Encoder;
+		}
+
+		// Writes the raw LZMA stream, SZ_ERROR_OUTPUT_EOF if it doesn't fit into *pOutputSize bytes
+		SRes Encode( const Byte* pInput, size_t inputSize, Byte* pOutput, size_t* pOutputSize, Byte* pProperties )
+		{
+			if ( !m_hEnc )
+				return SZ_ERROR_MEM;
+
+			CLzmaEncProps props;
+			LzmaEncProps_Init( &props );
+			props.reduceSize = inputSize;
 
-		COutStreamRam outStream( outBuffer, outSize );
+			SRes res = LzmaEnc_SetProps( m_hEnc, &props );
+			if ( res != SZ_OK )
+				return res;
 
-		Byte header[LZMA_PROPS_SIZE + 8];
-		size_t headerSize = LZMA_PROPS_SIZE;
+			SizeT propsSize = LZMA_PROPS_SIZE;
+			res = LzmaEnc_WriteProperties( m_hEnc, pProperties, &propsSize );
+			if ( res != SZ_OK )
+				return res;
 
-		res = LzmaEnc_WriteProperties( enc, header, &headerSize );
-		if ( res != SZ_OK )
+			SizeT outSize = *pOutputSize;
+			res = LzmaEnc_MemEncode( m_hEnc, pOutput, &outSize, pInput, inputSize, 0, nullptr, &g_Alloc, &g_Alloc );
+			*pOutputSize = outSize;
 			return res;
+		}
 
-		// Uncompressed size after properties in header
-		for ( int i = 0; i < 8; i++ )
-			header[headerSize++] = static_cast<Byte>( inSize >> ( 8 * i ) );
+	private:
+		CLzmaEncHandle m_hEnc;
+	};
 
-		if ( outStream.DoWrite( header, headerSize ) != headerSize )
-			res = SZ_ERROR_WRITE;
-		else if ( res == SZ_OK )
-		{
-			CInStreamRam inStream( inBuffer, inSize );
-			res = LzmaEnc_Encode( enc, &outStream, &inStream, nullptr, &g_Alloc, &g_Alloc );
+	// Compresses into pOutput with our header up front, false if it doesn't fit into outputSize bytes
+	static inline bool CompressTo( const uint8_t* pInput, size_t inputSize, uint8_t* pOutput, size_t outputSize, size_t* pOutputSize )
+	{
+		*pOutputSize = 0;
+		if ( outputSize <= sizeof( lzma_header_t ) )
+			return false;
 
-			if ( outStream.Overflow )
-				res = SZ_ERROR_FAIL;
-			else
-				*outSizeProcessed = outStream.Pos;
+		// the stream goes straight after our header
+		lzma_header_t* pHeader = reinterpret_cast<lzma_header_t*>( pOutput );
+		size_t compressedSize  = outputSize - sizeof( lzma_header_t );
+		const SRes result	   = CEncoder::ForThread().Encode( pInput, inputSize, pOutput + sizeof( lzma_header_t ), &compressedSize, pHeader->properties );
+		if ( result != SZ_OK )
+		{
+			Assert( result == SZ_ERROR_OUTPUT_EOF );
+			return false;
 		}
 
-		LzmaEnc_Destroy( enc, &g_Alloc, &g_Alloc );
+		pHeader->id			= LZMA_ID;
+		pHeader->actualSize = gsl::narrow<uint32_t>( inputSize );
+		pHeader->lzmaSize	= gsl::narrow<uint32_t>( compressedSize );
 
-		return res;
+		// final output size is our header plus compressed bits
+		*pOutputSize = sizeof( lzma_header_t ) + compressedSize;
+		return true;
 	}
 
-	static inline uint8_t* Compress( uint8_t* pInput, size_t inputSize, size_t* pOutputSize )
+	static inline uint8_t* Compress( const uint8_t* pInput, size_t inputSize, size_t* pOutputSize )
 	{
-		*pOutputSize = 0;
-
 		// using same work buffer calcs as the SDK 105% + 64K
-		size_t outSize = inputSize / 20 * 21 + ( 1 << 16 );
+		const size_t outSize = inputSize / 20 * 21 + ( 1 << 16 );
 		uint8_t* pOutputBuffer = new uint8_t[outSize];
-		if ( !pOutputBuffer )
-			return nullptr;
-
-		// compress, skipping past our header
-		size_t compressedSize;
-		int result = LzmaEncode( pInput, inputSize, pOutputBuffer + sizeof( lzma_header_t ), outSize - sizeof( lzma_header_t ), &compressedSize );
-		if ( result != SZ_OK )
+		if ( !CompressTo( pInput, inputSize, pOutputBuffer, outSize, pOutputSize ) )
 		{
-			Assert( result == SZ_OK );
 			delete[] pOutputBuffer;
 			return nullptr;
 		}
 
-		// construct our header, strip theirs
-		lzma_header_t* pHeader = reinterpret_cast<lzma_header_t*>( pOutputBuffer );
-		pHeader->id = LZMA_ID;
-		pHeader->actualSize = gsl::narrow<uint32_t>( inputSize );
-		pHeader->lzmaSize = gsl::narrow<uint32_t>( compressedSize - 13 );
-		memcpy( pHeader->properties, pOutputBuffer + sizeof( lzma_header_t ), LZMA_PROPS_SIZE );
-
-		// shift the compressed data into place
-		memmove( pOutputBuffer + sizeof( lzma_header_t ), pOutputBuffer + sizeof( lzma_header_t ) + 13, compressedSize - 13 );
-
-		// final output size is our header plus compressed bits
-		*pOutputSize = sizeof( lzma_header_t ) + compressedSize - 13;
-
 		return pOutputBuffer;
 	}
 
-	static inline uint8_t* OpportunisticCompress( uint8_t* pInput, size_t inputSize, size_t* pOutputSize )
+	static inline uint8_t* OpportunisticCompress( const uint8_t* pInput, size_t inputSize, size_t* pOutputSize )
 	{
-		uint8_t* pRet = Compress( pInput, inputSize, pOutputSize );
-		if ( *pOutputSize >= inputSize )
+		if ( inputSize <= sizeof( lzma_header_t ) )
+			return nullptr;
+
+		// Only room for output smaller than the input, the encoder gives up
+		// as soon as compression gets worse or stays the same
+		uint8_t* pOutputBuffer = new uint8_t[inputSize];
+		if ( !CompressTo( pInput, inputSize, pOutputBuffer, inputSize - 1, pOutputSize ) )
 		{
-			// compression got worse or stayed the same
-			delete[] pRet;
+			delete[] pOutputBuffer;
 			return nullptr;
 		}
 
-		return pRet;
+		return pOutputBuffer;
 	}
 } // namespace LZMA
\ No newline at end of file
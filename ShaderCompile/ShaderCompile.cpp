@@ -5,51 +5,43 @@
 // $NoKeywords: $
 //
 //=============================================================================//
-// vmpi_bareshell.cpp : Defines the entry point for the console application.
+// ShaderCompile.cpp : Combo scheduling, packaging and .vcs writing.
 //
 
-#define WIN32_LEAN_AND_MEAN
-#define NOWINRES
-#define NOSERVICE
-#define NOMCX
-#define NOIME
-#define NOMINMAX
-
-#include <windows.h>
-
-#include <DbgHelp.h>
-#include <d3dcompiler.h>
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <functional>
 #include <memory>
-#include <future>
+#include <mutex>
 #include <filesystem>
-#include <regex>
 #include <set>
+#include <span>
 #include <thread>
-#include <immintrin.h>
 #include <inttypes.h>
 
 #include "basetypes.h"
 #include "cfgprocessor.h"
 #include "cmdsink.h"
-#include "d3dxfxc.h"
+#include "compilerbackend.h"
+#include "filecache.h"
+#include "platform.h"
+#include "shadercompile.h"
 #include "shader_vcs_version.h"
 #include "utlbuffer.h"
-#include "utlnodehash.h"
 
-#include "ezOptionParser.hpp"
 #include "termcolor/style.hpp"
 #include "gsl/narrow"
 #include "robin_hood.h"
 
-#include "CRC32.hpp"
 #include "movingaverage.hpp"
 #include "termcolors.hpp"
 #include "strmanip.hpp"
 #include "shaderparser.h"
-#include "scopednewhandler.hpp"
 
 extern "C" {
 #define _7ZIP_ST
@@ -63,10 +55,10 @@ extern "C" {
 
 #include "LZMA.hpp"
 
-#pragma comment( lib, "DbgHelp" )
-
+#ifdef _MSC_VER
 // Type conversions should be controlled by programmer explicitly - shadercompile makes use of 64-bit integer arithmetics
 #pragma warning( error : 4244 )
+#endif
 
 namespace clr
 {
@@ -89,46 +81,103 @@ namespace chrono = std::chrono;
 using std::chrono::duration_cast;
 using namespace std::literals;
 
-using Clock = chrono::high_resolution_clock;
-static fs::path g_pShaderPath;
-static Clock::time_point g_flStartTime;
-static bool g_bVerbose	= false;
-static bool g_bVerbose2 = false;
-static bool g_bFastFail = false;
+fs::path g_pShaderPath;
+Clock::time_point g_flStartTime;
+bool g_bVerbose	= false;
+bool g_bVerbose2 = false;
+bool g_bFastFail = false;
+bool g_bNoCompress = false;
+uint64_t g_nKeepPacked = 0;
+uint64_t g_nMemoryBudget = 4096ULL << 20;
 
 static constexpr const std::string_view lineRewind = "\033[2K"sv;
 static constexpr const std::string_view endLine = "\r"sv;
 
 struct ShaderInfo_t
 {
-	ShaderInfo_t() { memset( this, 0, sizeof( *this ) ); }
-
-	uint64_t m_nShaderCombo;
-	uint64_t m_nTotalShaderCombos;
+	uint64_t m_nShaderCombo = 0;
+	uint64_t m_nTotalShaderCombos = 0;
 	std::string_view m_pShaderName;
 	std::string_view m_pShaderSrc;
-	unsigned m_CentroidMask;
-	uint64_t m_nDynamicCombos;
-	uint64_t m_nStaticCombo;
-	uint32_t m_Crc32;
+	unsigned m_CentroidMask = 0;
+	uint64_t m_nDynamicCombos = 0;
+	uint64_t m_nStaticCombo = 0;
+	uint32_t m_Crc32 = 0;
 };
-static robin_hood::unordered_node_map<std::string_view, ShaderInfo_t> g_ShaderToShaderInfo;
 
 static void Shader_ParseShaderInfoFromCompileCommands( const CfgProcessor::CfgEntryInfo* pEntry, ShaderInfo_t& shaderInfo );
 
-struct CByteCodeBlock : private std::unique_ptr<uint8_t[]>
+// Bump allocator for the bytecode of one static combo, everything is freed at once
+class CByteCodeArena
 {
-	uint64_t m_nComboID;
-	size_t m_nCodeSize;
+public:
+	[[nodiscard]] uint8_t* Alloc( size_t nSize )
+	{
+		if ( m_nPageLeft < nSize )
+		{
+			// Pages double in size, static combos with a few small shaders stay small
+			m_nNextPageSize = std::min( m_nNextPageSize * 2, MaxPageSize );
+			const size_t nPageSize = std::max( nSize, m_nNextPageSize );
+			m_arrPages.emplace_back( new uint8_t[nPageSize] );
+			m_pPageCur  = m_arrPages.back().get();
+			m_nPageLeft = nPageSize;
+		}
+
+		uint8_t* const pData = m_pPageCur;
+		m_pPageCur += nSize;
+		m_nPageLeft -= nSize;
+		return pData;
+	}
 
-	CByteCodeBlock( const void* pByteCode, size_t nCodeSize, uint64_t nComboID ) : std::unique_ptr<uint8_t[]>( new uint8_t[nCodeSize] )
+	void Release() noexcept
 	{
-		m_nComboID  = nComboID;
-		m_nCodeSize = nCodeSize;
-		memcpy( get(), pByteCode, nCodeSize );
+		m_arrPages.clear();
+		m_arrPages.shrink_to_fit();
+		m_pPageCur		= nullptr;
+		m_nPageLeft		= 0;
+		m_nNextPageSize = MinPageSize / 2;
 	}
 
-	using std::unique_ptr<uint8_t[]>::get;
+private:
+	static constexpr size_t MinPageSize = 16 * 1024;
+	static constexpr size_t MaxPageSize = 1024 * 1024;
+
+	std::vector<std::unique_ptr<uint8_t[]>> m_arrPages;
+	uint8_t* m_pPageCur		= nullptr;
+	size_t m_nPageLeft		= 0;
+	size_t m_nNextPageSize	= MinPageSize / 2;
+};
+
+// Bytecode and packed code of static combos not stored yet, for the memory budget
+static std::atomic<uint64_t> g_nBytesInFlight;
+
+// Workers over the memory budget wait for packaging and writing to free some of it
+static std::mutex g_mtxBudget;
+static std::condition_variable g_cvBudget;
+static std::atomic<uint32_t> g_nBudgetWaiters;
+
+// Call after changing what the waiters check, they recheck it under g_mtxBudget
+static void NotifyBudgetWaiters()
+{
+	if ( g_nBudgetWaiters.load() )
+	{
+		std::lock_guard guard{ g_mtxBudget };
+		g_cvBudget.notify_all();
+	}
+}
+
+static void ReleaseBytesInFlight( uint64_t nBytes )
+{
+	g_nBytesInFlight.fetch_sub( nBytes );
+	if ( nBytes )
+		NotifyBudgetWaiters();
+}
+
+struct CByteCodeBlock
+{
+	uint64_t m_nComboID;
+	size_t m_nCodeSize;
+	const uint8_t* m_pCode; // in the arena of the static combo
 };
 
 struct CStaticCombo // all the data for one static combo
@@ -162,57 +211,74 @@ struct CStaticCombo // all the data for one static combo
 
 		using std::unique_ptr<uint8_t[]>::operator bool;
 	};
-	CStaticCombo *m_pNext, *m_pPrev;
 private:
 	uint64_t m_nStaticComboID;
+	std::atomic<uint64_t> m_nCommandsLeft; // commands of it not finished yet, skipped and failed ones included
 
-	std::vector<std::unique_ptr<CByteCodeBlock>> m_DynamicCombos;
+	std::mutex m_mtxAdd; // workers finishing dynamic combos of it at once
+	std::vector<CByteCodeBlock> m_DynamicCombos;
+	CByteCodeArena m_ByteCode;
+	size_t m_nByteCodeSize = 0; // counted in g_nBytesInFlight
 
 	PackedCode m_abPackedCode; // Packed code for entire static combo
+	size_t m_nPackedCodeSize = 0; // counted in g_nBytesInFlight until kept for writing
 
-	static bool CompareDynamicComboIDs( const std::unique_ptr<CByteCodeBlock>& pA, const std::unique_ptr<CByteCodeBlock>& pB )
+	static bool CompareDynamicComboIDs( const CByteCodeBlock& a, const CByteCodeBlock& b )
 	{
-		return pA->m_nComboID < pB->m_nComboID;
+		return a.m_nComboID < b.m_nComboID;
 	}
 
 public:
-	[[nodiscard]] uint64_t Key() const
-	{
-		return m_nStaticComboID;
-	}
-
 	[[nodiscard]] uint64_t ComboId() const
 	{
 		return m_nStaticComboID;
 	}
 
-	[[nodiscard]] CStaticCombo* Next() const
-	{
-		return m_pNext;
-	}
-
 	[[nodiscard]] const PackedCode& Code() const
 	{
 		return m_abPackedCode;
 	}
 
-	[[nodiscard]] const std::vector<std::unique_ptr<CByteCodeBlock>>& DynamicCombos() const
+	[[nodiscard]] const std::vector<CByteCodeBlock>& DynamicCombos() const
 	{
 		return m_DynamicCombos;
 	}
 
-	CStaticCombo( uint64_t nComboID )
+	CStaticCombo( uint64_t nComboID, uint64_t nCommands, size_t nDynamicCombos )
 	{
 		m_nStaticComboID = nComboID;
-		m_pNext = nullptr;
-		m_pPrev = nullptr;
+		m_nCommandsLeft.store( nCommands, std::memory_order_relaxed );
+		m_DynamicCombos.reserve( nDynamicCombos );
 	}
 
-	~CStaticCombo() = default;
+	~CStaticCombo()
+	{
+		ReleaseBytesInFlight( m_nByteCodeSize + m_nPackedCodeSize );
+	}
 
 	void AddDynamicCombo( uint64_t nComboID, const void* pComboData, size_t nCodeSize )
 	{
-		m_DynamicCombos.emplace_back( std::make_unique<CByteCodeBlock>( pComboData, nCodeSize, nComboID ) );
+		std::lock_guard guard{ m_mtxAdd };
+		uint8_t* const pCode = m_ByteCode.Alloc( nCodeSize );
+		memcpy( pCode, pComboData, nCodeSize );
+		m_DynamicCombos.emplace_back( CByteCodeBlock{ nComboID, nCodeSize, pCode } );
+		m_nByteCodeSize += nCodeSize;
+		g_nBytesInFlight.fetch_add( nCodeSize, std::memory_order_relaxed );
+	}
+
+	// True when these are the last of its commands, the static combo is complete then
+	[[nodiscard]] bool FinishCommands( uint64_t nCommands ) noexcept
+	{
+		return m_nCommandsLeft.fetch_sub( nCommands, std::memory_order_acq_rel ) == nCommands;
+	}
+
+	// Once packed the bytecode isn't needed anymore
+	void ReleaseByteCode() noexcept
+	{
+		m_DynamicCombos.clear();
+		m_DynamicCombos.shrink_to_fit();
+		m_ByteCode.Release();
+		ReleaseBytesInFlight( std::exchange( m_nByteCodeSize, 0 ) );
 	}
 
 	void SortDynamicCombos()
@@ -222,37 +288,25 @@ public:
 
 	[[nodiscard]] uint8_t* AllocPackedCodeBlock( size_t nPackedCodeSize )
 	{
+		g_nBytesInFlight.fetch_add( nPackedCodeSize, std::memory_order_relaxed );
+		ReleaseBytesInFlight( std::exchange( m_nPackedCodeSize, nPackedCodeSize ) );
 		return m_abPackedCode.AllocData( nPackedCodeSize );
 	}
-};
-
-using StaticComboNodeHash_t = CUtlNodeHash<CStaticCombo, 7097, uint64_t>;
-using CShaderMap = robin_hood::unordered_map<std::string_view, StaticComboNodeHash_t*>;
-static CShaderMap g_ShaderByteCode;
-
-static CStaticCombo* StaticComboFromDictAdd( std::string_view pszShaderName, uint64_t nStaticComboId )
-{
-	StaticComboNodeHash_t* &rpNodeHash = g_ShaderByteCode[pszShaderName];
-	if ( !rpNodeHash )
-		rpNodeHash = new StaticComboNodeHash_t;
 
-	// search for this static combo. make it if not found
-	CStaticCombo* pStaticCombo = rpNodeHash->FindByKey( nStaticComboId );
-	if ( !pStaticCombo )
+	// Packed code kept in memory for writing is bounded by -keeppacked instead of the memory budget
+	void UncountPackedCode() noexcept
 	{
-		pStaticCombo = new CStaticCombo( nStaticComboId );
-		rpNodeHash->Add( pStaticCombo );
+		ReleaseBytesInFlight( std::exchange( m_nPackedCodeSize, 0 ) );
 	}
+};
 
-	return pStaticCombo;
-}
-
-static CStaticCombo* StaticComboFromDict( std::string_view pszShaderName, uint64_t nStaticComboId )
+// Static combos of a shader still compiling, looked up by id. Only a few
+// of those are around at any time, packaging takes them out.
+struct alignas( 64 ) CStaticComboShard
 {
-	if ( StaticComboNodeHash_t* pNodeHash = g_ShaderByteCode[pszShaderName] )
-		return pNodeHash->FindByKey( nStaticComboId );
-	return nullptr;
-}
+	std::mutex m_mtx;
+	robin_hood::unordered_flat_map<uint64_t, std::unique_ptr<CStaticCombo>> m_mapCompiling;
+};
 
 class CompilerMsgInfo
 {
@@ -274,14 +328,129 @@ protected:
 	uint64_t m_numTimesReported;
 };
 
-static robin_hood::unordered_flat_set<std::string_view> g_ShaderHadError;
-static robin_hood::unordered_flat_set<std::string_view> g_ShaderWrittenToDisk;
 struct CompilerMsg
 {
 	robin_hood::unordered_node_map<std::string, CompilerMsgInfo> warning;
 	robin_hood::unordered_node_map<std::string, CompilerMsgInfo> error;
 };
-static robin_hood::unordered_node_map<std::string_view, CompilerMsg> g_CompilerMsg;
+
+// Packed static combos of a shader are appended to a scratch file next to the .vcs
+// as soon as they are packaged, only their place in it stays in memory. With
+// -keeppacked a shader keeps that much of them in memory, past it all of them go
+// to the scratch file at once.
+// Identical static combos are stored once, the lowest id owns the data and the
+// others alias it, they are found by a 64-bit hash of the packed code. The .vcs is
+// put together once the shader is done, as the engine wants the static combos in
+// the order of the dictionary.
+class CPackedComboWriter
+{
+public:
+	~CPackedComboWriter() { Discard(); }
+
+	// Safe to call from several packaging threads, false if the scratch file can't be written
+	[[nodiscard]] bool Append( const ShaderInfo_t& shaderInfo, std::unique_ptr<CStaticCombo> pStatic );
+
+	[[nodiscard]] bool Empty();
+	// False if the .vcs can't be written or the scratch file can't be read back, the shader fails then
+	[[nodiscard]] bool WriteVCS( const fs::path& path, const ShaderInfo_t& shaderInfo );
+	void Discard();
+
+private:
+	struct PackedRecord_t
+	{
+		uint32_t m_nStaticComboID; // lowest id with this packed code
+		uint32_t m_nSize;
+		uint64_t m_nScratchOffset;
+		size_t m_nNextSameHash; // next record with the same hash, different code
+		std::unique_ptr<CStaticCombo> m_pStatic; // holds the packed code until spilled
+	};
+	static constexpr size_t NoRecord = ~size_t( 0 );
+
+	struct AliasRecord_t
+	{
+		uint32_t m_nStaticComboID;
+		size_t m_nRecord;
+	};
+
+	// Null if the scratch file can't be read
+	[[nodiscard]] const uint8_t* ReadBack( const PackedRecord_t& rec );
+	[[nodiscard]] bool Spill( const ShaderInfo_t& shaderInfo );
+	[[nodiscard]] bool Fail( std::string_view szWhat );
+	void ReleaseRecords() noexcept;
+
+	std::mutex m_mtx;
+	fs::path m_ScratchPath;
+	std::fstream m_Scratch;
+	uint64_t m_nScratchSize = 0;
+	size_t m_nSpilled		= 0; // records before this one are in the scratch file
+	uint64_t m_nKeptSize	= 0; // packed code of the records from m_nSpilled on
+	bool m_bFailed			= false; // scratch file couldn't be written or read, the shader fails
+	std::vector<PackedRecord_t> m_arrRecords;
+	std::vector<AliasRecord_t> m_arrAliases;
+	robin_hood::unordered_flat_map<uint64_t, size_t> m_mapByHash; // first record with the hash
+	std::vector<uint8_t> m_arrReadBack;
+};
+
+// Everything the pipeline keeps about one shader. Combo handles reach it
+// through their entry, so compiled combos only ever lock their own shader.
+struct ShaderCompileContext
+{
+	static constexpr uint64_t NumShards = 16;
+
+	ShaderInfo_t m_ShaderInfo;
+
+	// Sharded by static combo id, workers on different static combos don't meet
+	CStaticComboShard m_arrCompiling[NumShards];
+
+	CPackedComboWriter m_Writer;
+
+	std::mutex m_mtxMsg;
+	CompilerMsg m_Msg;
+
+	std::atomic<bool> m_bHadError{ false };
+	// Commands not finished yet, skipped ones included. The last command of a static
+	// combo only finishes once it is stored, shader is written out once it drops to zero.
+	std::atomic<uint64_t> m_nCommandsLeft{ 0 };
+	std::atomic<bool> m_bWrittenToDisk{ false };
+};
+
+// In the order of the entries
+static std::vector<std::unique_ptr<ShaderCompileContext>> g_arrShaderContexts;
+// Combos left after SKIP which are not compiled yet, for the progress
+static std::atomic<uint64_t> g_nPendingCombos;
+// False when some shader had too many combos to count, g_nPendingCombos is an upper bound then
+static bool g_bPendingCombosExact = true;
+
+// The static combo stays put until all of its commands are finished and it is packaged,
+// so the caller can add its dynamic combo without holding the shard.
+static CStaticCombo* StaticComboFromDictAdd( const CfgProcessor::CfgEntryInfo* pEntry, uint64_t nStaticComboId )
+{
+	CStaticComboShard& shard = pEntry->m_pContext->m_arrCompiling[nStaticComboId % ShaderCompileContext::NumShards];
+	std::lock_guard guard{ shard.m_mtx };
+
+	// search for this static combo. make it if not found
+	std::unique_ptr<CStaticCombo>& rpStaticCombo = shard.m_mapCompiling[nStaticComboId];
+	if ( !rpStaticCombo )
+		rpStaticCombo = std::make_unique<CStaticCombo>( nStaticComboId, pEntry->m_numDynamicCombos, CfgProcessor::GetNonSkippedDynamicCombos( pEntry, nStaticComboId ) );
+
+	return rpStaticCombo.get();
+}
+
+// Takes the static combo out for packaging
+static std::unique_ptr<CStaticCombo> StaticComboFromDictRemove( ShaderCompileContext* pContext, uint64_t nStaticComboId )
+{
+	CStaticComboShard& shard = pContext->m_arrCompiling[nStaticComboId % ShaderCompileContext::NumShards];
+	std::lock_guard guard{ shard.m_mtx };
+
+	auto& mapCompiling = shard.m_mapCompiling;
+	const auto itCombo = mapCompiling.find( nStaticComboId );
+	if ( itCombo == mapCompiling.end() )
+		return nullptr;
+
+	std::unique_ptr<CStaticCombo> pStaticCombo = std::move( itCombo->second );
+	mapCompiling.erase( itCombo );
+	return pStaticCombo;
+}
 
 namespace Threading
 {
@@ -309,6 +478,13 @@ public:
 			pUseMtx->lock();
 	}
 
+	bool try_lock()
+	{
+		if ( mtx_type* pUseMtx = m_pUseMtx )
+			return pUseMtx->try_lock();
+		return true;
+	}
+
 	void unlock()
 	{
 		if ( mtx_type* pUseMtx = m_pUseMtx )
@@ -322,17 +498,15 @@ private:
 namespace Private
 {
 	static std::mutex g_mtxSyncObjMT;
-	static std::mutex g_mtxSyncObjMT2;
 }; // namespace Private
 
-static CSwitchableMutex<Private::g_mtxSyncObjMT> g_mtxGlobal;
-static CSwitchableMutex<Private::g_mtxSyncObjMT2> g_mtxMsgReport;
+static CSwitchableMutex<Private::g_mtxSyncObjMT> g_mtxConsole;
 }; // namespace Threading
 
-static void ErrMsgDispatchMsgLine( const char* szCommand, const char* szMsgLine, std::string_view szName )
+static void ErrMsgDispatchMsgLine( const char* szCommand, const char* szMsgLine, ShaderCompileContext* pContext )
 {
-	std::lock_guard guard{ Threading::g_mtxMsgReport };
-	auto& msg = g_CompilerMsg[szName];
+	std::lock_guard guard{ pContext->m_mtxMsg };
+	auto& msg = pContext->m_Msg;
 
 	const size_t msgLineLen = strlen( szMsgLine );
 	char* dupMsg = new char[ msgLineLen + 1 ];
@@ -363,11 +537,6 @@ static void ErrMsgDispatchMsgLine( const char* szCommand, const char* szMsgLine,
 	delete[] dupMsg;
 }
 
-static void ShaderHadErrorDispatchInt( std::string_view szShader )
-{
-	g_ShaderHadError.emplace( szShader );
-}
-
 // new format:
 // ver#
 // total shader combos
@@ -412,47 +581,59 @@ static bool CompareDupComboIndices( const StaticComboAliasRecord_t& pA, const St
 	return pA.m_nStaticComboID < pB.m_nStaticComboID;
 }
 
-static void FlushCombos( size_t& pnTotalFlushedSize, CUtlBuffer& pDynamicComboBuffer, CUtlBuffer& pBuf )
+// Dynamic combos of a static combo are cut into blocks of at most MAX_SHADER_UNPACKED_BLOCK_SIZE,
+// every block is compressed on its own, so the blocks can be compressed in any order.
+struct DynamicComboBlock_t
+{
+	int m_nStart; // offset into the buffer of unpacked dynamic combos
+	uint32_t m_nSize;
+	std::unique_ptr<uint8_t[]> m_pCompressed; // null if the block is stored as is
+	size_t m_nCompressedSize;
+};
+
+static void CompressBlock( const uint8_t* pDynamicCombos, DynamicComboBlock_t& block )
 {
-	if ( !pDynamicComboBuffer.TellPut() )
-		// Nothing to do here
+	if ( g_bNoCompress )
+	{
+		block.m_nCompressedSize = block.m_nSize;
 		return;
+	}
+
+	size_t nCompressedSize = 0;
+	block.m_pCompressed.reset( LZMA::OpportunisticCompress( pDynamicCombos + block.m_nStart, block.m_nSize, &nCompressedSize ) );
+	block.m_nCompressedSize = block.m_pCompressed ? nCompressedSize : block.m_nSize;
+}
 
-	size_t nCompressedSize;
-	uint8_t* pCompressedShader = LZMA::OpportunisticCompress( reinterpret_cast<uint8_t*>( pDynamicComboBuffer.Base() ), pDynamicComboBuffer.TellPut(), &nCompressedSize );
+[[nodiscard]] static size_t GetPackedBlockSize( const DynamicComboBlock_t& block ) noexcept
+{
+	return sizeof( uint32_t ) + block.m_nCompressedSize;
+}
+
+static uint8_t* PutPackedBlock( uint8_t* pOut, const uint8_t* pDynamicCombos, const DynamicComboBlock_t& block )
+{
 	// high 2 bits of length =
 	// 00 = bzip2 compressed
 	// 10 = uncompressed
 	// 01 = lzma compressed
 	// 11 = unused
+	const uint32_t lFlagSize = block.m_pCompressed ? 0x40000000 | gsl::narrow<uint32_t>( block.m_nCompressedSize ) : 0x80000000 | block.m_nSize;
+	memcpy( pOut, &lFlagSize, sizeof( lFlagSize ) );
+	pOut += sizeof( lFlagSize );
 
-	if ( !pCompressedShader )
-	{
-		// it grew
-		const uint32_t lFlagSize = 0x80000000 | pDynamicComboBuffer.TellPut();
-		pBuf.Put( &lFlagSize, sizeof( lFlagSize ) );
-		pBuf.Put( pDynamicComboBuffer.Base(), pDynamicComboBuffer.TellPut() );
-		pnTotalFlushedSize += sizeof( lFlagSize ) + pDynamicComboBuffer.TellPut();
-	}
-	else
-	{
-		const uint32_t lFlagSize = 0x40000000 | gsl::narrow<uint32_t>( nCompressedSize );
-		pBuf.Put( &lFlagSize, sizeof( lFlagSize ) );
-		pBuf.Put( pCompressedShader, gsl::narrow<uint32_t>( nCompressedSize ) );
-		delete[] pCompressedShader;
-		pnTotalFlushedSize += sizeof( lFlagSize ) + nCompressedSize;
-	}
-	pDynamicComboBuffer.Clear(); // start over
+	const uint8_t* pData = block.m_pCompressed ? block.m_pCompressed.get() : pDynamicCombos + block.m_nStart;
+	memcpy( pOut, pData, block.m_nCompressedSize );
+	return pOut + block.m_nCompressedSize;
 }
 
-static void OutputDynamicCombo( size_t& pnTotalFlushedSize, CUtlBuffer& pDynamicComboBuffer, CUtlBuffer& pBuf, uint64_t nComboID, uint32_t nComboSize, const uint8_t* pComboCode )
+static void OutputDynamicCombo( std::vector<DynamicComboBlock_t>& arrBlocks, CUtlBuffer& pDynamicComboBuffer, uint64_t nComboID, uint32_t nComboSize, const uint8_t* pComboCode )
 {
-	if ( pDynamicComboBuffer.TellPut() + nComboSize + 16 >= MAX_SHADER_UNPACKED_BLOCK_SIZE )
-		FlushCombos( pnTotalFlushedSize, pDynamicComboBuffer, pBuf );
+	if ( arrBlocks.empty() || arrBlocks.back().m_nSize + nComboSize + 16 >= MAX_SHADER_UNPACKED_BLOCK_SIZE )
+		arrBlocks.emplace_back( DynamicComboBlock_t { pDynamicComboBuffer.TellPut(), 0, nullptr, 0 } );
 
 	pDynamicComboBuffer.PutUnsignedInt( gsl::narrow<uint32_t>( nComboID ) );
 	pDynamicComboBuffer.PutUnsignedInt( nComboSize );
 	pDynamicComboBuffer.Put( pComboCode, nComboSize );
+	arrBlocks.back().m_nSize += sizeof( uint32_t ) * 2 + nComboSize;
 }
 
 static fs::path GetVCSFilenames( const ShaderInfo_t& si )
@@ -462,6 +643,7 @@ static fs::path GetVCSFilenames( const ShaderInfo_t& si )
 	fs::directory_entry status( path );
 	if ( !status.exists() )
 	{
+		std::lock_guard guard{ Threading::g_mtxConsole };
 		std::cout << clr::pinkish << "mkdir "sv << path << clr::reset;
 		// doh. . need to make the directory that the vcs file is going to go into.
 		std::error_code c;
@@ -496,57 +678,233 @@ static fs::path GetVCSFilenames( const ShaderInfo_t& si )
 	return path;
 }
 
-// WriteShaderFiles
-//
-// should be called either on the main thread or
-// on the async writing thread.
-//
-// So the function WriteShaderFiles should not be reentrant, however the
-// data that it uses might be updated by the main thread when built pieces
-// are received from the workers.
-//
-static constexpr uint32_t STATIC_COMBO_HASH_SIZE = 73;
+bool CPackedComboWriter::Append( const ShaderInfo_t& shaderInfo, std::unique_ptr<CStaticCombo> pStatic )
+{
+	const CStaticCombo::PackedCode& code = pStatic->Code();
+	const uint32_t nComboId = gsl::narrow<uint32_t>( pStatic->ComboId() );
+	const uint32_t nSize	= gsl::narrow<uint32_t>( code.GetLength() );
+	const uint64_t nHash	= robin_hood::hash_bytes( code.GetData(), nSize );
+
+	std::lock_guard guard{ m_mtx };
+	if ( m_bFailed )
+		return false;
+
+	// now, see if we have an identical static combo, the code is only compared on a hash match
+	const auto [itHash, bNewHash] = m_mapByHash.try_emplace( nHash, m_arrRecords.size() );
+	size_t iLastSameHash		  = NoRecord;
+	for ( size_t i = bNewHash ? NoRecord : itHash->second; i != NoRecord; i = m_arrRecords[i].m_nNextSameHash )
+	{
+		PackedRecord_t& check = m_arrRecords[i];
+		iLastSameHash		  = i;
+		if ( check.m_nSize != nSize )
+			continue;
+
+		const uint8_t* pCheckCode = ReadBack( check );
+		if ( !pCheckCode )
+			return Fail( "read"sv );
+		if ( memcmp( pCheckCode, code.GetData(), nSize ) == 0 )
+		{
+			// this static combo is the same as another one!!
+			m_arrAliases.emplace_back( AliasRecord_t { std::max( check.m_nStaticComboID, nComboId ), i } );
+			check.m_nStaticComboID = std::min( check.m_nStaticComboID, nComboId );
+			return true;
+		}
+	}
+
+	if ( iLastSameHash != NoRecord )
+		m_arrRecords[iLastSameHash].m_nNextSameHash = m_arrRecords.size();
+	m_arrRecords.emplace_back( PackedRecord_t { nComboId, nSize, 0, NoRecord, std::move( pStatic ) } );
+
+	// Up to -keeppacked the code stays here, past it everything kept goes to the scratch file
+	m_nKeptSize += nSize;
+	if ( m_nKeptSize > g_nKeepPacked )
+		return Spill( shaderInfo );
 
-struct StaticComboAuxInfo_t : StaticComboRecord_t
+	m_arrRecords.back().m_pStatic->UncountPackedCode();
+	return true;
+}
+
+bool CPackedComboWriter::Spill( const ShaderInfo_t& shaderInfo )
 {
-	uint32_t m_nCRC32; // CRC32 of packed data
-	CStaticCombo* m_pByteCode;
-};
+	if ( !m_Scratch.is_open() )
+	{
+		m_ScratchPath = GetVCSFilenames( shaderInfo ) += ".tmp"sv;
+		m_Scratch.open( m_ScratchPath, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc );
+		if ( !m_Scratch )
+			return Fail( "open"sv );
+	}
+
+	m_Scratch.seekp( m_nScratchSize );
+	for ( ; m_Scratch && m_nSpilled < m_arrRecords.size(); ++m_nSpilled )
+	{
+		PackedRecord_t& rec = m_arrRecords[m_nSpilled];
+		m_Scratch.write( reinterpret_cast<const char*>( rec.m_pStatic->Code().GetData() ), rec.m_nSize );
+		rec.m_nScratchOffset = m_nScratchSize;
+		rec.m_pStatic.reset();
+		m_nScratchSize += rec.m_nSize;
+	}
+	m_nKeptSize = 0;
+	return m_Scratch || Fail( "write"sv );
+}
 
-static bool CompareComboIds( const StaticComboAuxInfo_t& pA, const StaticComboAuxInfo_t& pB ) noexcept
+bool CPackedComboWriter::Fail( std::string_view szWhat )
 {
-	return pA.m_nStaticComboID < pB.m_nStaticComboID;
+	{
+		std::lock_guard guardConsole{ Threading::g_mtxConsole };
+		std::cout << "\r"sv << clr::escaped( lineRewind ) << clr::red << "Couldn't "sv << szWhat << " "sv << m_ScratchPath << "!"sv << clr::reset << std::endl;
+	}
+
+	// The shader fails, the packed code it holds is of no use anymore
+	m_bFailed = true;
+	ReleaseRecords();
+	return false;
 }
 
-static void WriteShaderFiles( std::string_view pShaderName )
+const uint8_t* CPackedComboWriter::ReadBack( const PackedRecord_t& rec )
 {
-	if ( !g_ShaderWrittenToDisk.emplace( pShaderName ).second )
-		return;
+	if ( rec.m_pStatic )
+		return rec.m_pStatic->Code().GetData();
+
+	m_arrReadBack.resize( std::max<size_t>( m_arrReadBack.size(), rec.m_nSize ) );
+	m_Scratch.seekg( rec.m_nScratchOffset );
+	m_Scratch.read( reinterpret_cast<char*>( m_arrReadBack.data() ), rec.m_nSize );
+	if ( !m_Scratch || static_cast<uint64_t>( m_Scratch.gcount() ) != rec.m_nSize )
+		return nullptr;
+	return m_arrReadBack.data();
+}
 
-	const bool bShaderFailed                = g_ShaderHadError.contains( pShaderName );
-	const char* const szShaderFileOperation = bShaderFailed ? "Removing failed" : "Writing";
+bool CPackedComboWriter::Empty()
+{
+	std::lock_guard guard{ m_mtx };
+	return m_arrRecords.empty();
+}
 
-	static Clock::time_point lastTime = g_flStartTime;
+bool CPackedComboWriter::WriteVCS( const fs::path& path, const ShaderInfo_t& shaderInfo )
+{
+	std::lock_guard guard{ m_mtx };
+	if ( m_bFailed )
+		return false;
+
+	// Aliases point to records, resolve them while records are in place
+	std::vector<StaticComboAliasRecord_t> duplicateCombos;
+	duplicateCombos.reserve( m_arrAliases.size() );
+	for ( const AliasRecord_t& alias : m_arrAliases )
+		duplicateCombos.emplace_back( StaticComboAliasRecord_t { alias.m_nStaticComboID, m_arrRecords[alias.m_nRecord].m_nStaticComboID } );
+	// sort duplicate combo records for binary search
+	std::sort( duplicateCombos.begin(), duplicateCombos.end(), CompareDupComboIndices );
+
+	std::sort( m_arrRecords.begin(), m_arrRecords.end(), []( const PackedRecord_t& a, const PackedRecord_t& b ) { return a.m_nStaticComboID < b.m_nStaticComboID; } );
 
 	//
-	// Progress indication
+	// Shader file stream buffer
 	//
-	std::cout << "\r"sv << clr::escaped( lineRewind ) << szShaderFileOperation << " "sv << (bShaderFailed ? clr::red : clr::green) << pShaderName << clr::reset << "..."sv << endLine;
+	std::ofstream ShaderFile( path, std::ios::binary | std::ios::trunc ); // Streaming buffer for vcs file (since this can blow memory)
+	if ( !ShaderFile )
+		return false;
+
+	// ------ Header --------------
+	const ShaderHeader_t header {
+		SHADER_VCS_VERSION_NUMBER,
+		gsl::narrow_cast<int32_t>( shaderInfo.m_nTotalShaderCombos ), // this is not actually used in vertexshaderdx8.cpp for combo checking
+		gsl::narrow<int32_t>( shaderInfo.m_nDynamicCombos ),          // this is used
+		0,
+		shaderInfo.m_CentroidMask,
+		gsl::narrow<uint32_t>( m_arrRecords.size() + 1 ),
+		shaderInfo.m_Crc32
+	};
+	ShaderFile.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+
+	// static combo dictionary, the static combos follow the duplicate records back to back
+	constexpr uint32_t endMark = 0xffffffff; // end of dynamic combos
+	std::vector<StaticComboRecord_t> StaticComboHeaders;
+	StaticComboHeaders.reserve( m_arrRecords.size() + 1 );
+
+	size_t nFileOffset = sizeof( header ) + sizeof( StaticComboRecord_t ) * ( m_arrRecords.size() + 1 ) + sizeof( uint32_t ) + sizeof( StaticComboAliasRecord_t ) * duplicateCombos.size();
+	for ( const PackedRecord_t& rec : m_arrRecords )
+	{
+		StaticComboHeaders.emplace_back( StaticComboRecord_t { rec.m_nStaticComboID, gsl::narrow<uint32_t>( nFileOffset ) } );
+		nFileOffset += rec.m_nSize + sizeof( endMark );
+	}
+	// add sentinel key, it is the largest one
+	StaticComboHeaders.emplace_back( StaticComboRecord_t { 0xffffffff, gsl::narrow<uint32_t>( nFileOffset ) } );
+
+	ShaderFile.write( reinterpret_cast<const char*>( StaticComboHeaders.data() ), sizeof( StaticComboRecord_t ) * StaticComboHeaders.size() );
+
+	const uint32_t dupl = gsl::narrow<uint32_t>( duplicateCombos.size() );
+	ShaderFile.write( reinterpret_cast<const char*>( &dupl ), sizeof( dupl ) );
+	ShaderFile.write( reinterpret_cast<const char*>( duplicateCombos.data() ), sizeof( StaticComboAliasRecord_t ) * duplicateCombos.size() );
+
+	// now, write out all static combos
+	for ( const PackedRecord_t& rec : m_arrRecords )
+	{
+		const uint8_t* pCode = ReadBack( rec );
+		if ( !pCode )
+			return Fail( "read"sv );
+		ShaderFile.write( reinterpret_cast<const char*>( pCode ), rec.m_nSize );
+		ShaderFile.write( reinterpret_cast<const char*>( &endMark ), sizeof( endMark ) );
+	}
+
+	// A full disk only shows up here, the shader fails instead of leaving a truncated file
+	ShaderFile.close();
+	return !ShaderFile.fail();
+}
+
+void CPackedComboWriter::Discard()
+{
+	std::lock_guard guard{ m_mtx };
+	if ( m_Scratch.is_open() )
+	{
+		m_Scratch.close();
+		std::error_code c;
+		fs::remove( m_ScratchPath, c );
+	}
+
+	m_nScratchSize	= 0;
+	m_bFailed		= false;
+	ReleaseRecords();
+}
+
+void CPackedComboWriter::ReleaseRecords() noexcept
+{
+	m_nSpilled	= 0;
+	m_nKeptSize	= 0;
+	m_arrRecords.clear();
+	m_arrRecords.shrink_to_fit();
+	m_arrAliases  = {};
+	m_arrReadBack = {};
+	m_mapByHash	  = {};
+}
+
+// WriteShaderFiles
+//
+// is called by the writer thread that stored the last static combo
+// of the shader, while the workers carry on compiling.
+//
+// Several shaders can be written at once, every one of them only
+// touches its own context. Console output is under g_mtxConsole.
+//
+static void WriteShaderFiles( ShaderCompileContext* pContext )
+{
+	if ( pContext->m_bWrittenToDisk.exchange( true ) )
+		return;
+
+	const std::string_view pShaderName = pContext->m_ShaderInfo.m_pShaderName;
+	const bool bShaderFailed = pContext->m_bHadError.load();
+	const char* const szShaderFileOperation = bShaderFailed ? "Removing failed" : "Writing";
+
+	static Clock::time_point lastTime = g_flStartTime; // under g_mtxConsole
 
 	//
-	// Retrieve the data we are going to operate on
-	// from global variables under lock.
+	// Progress indication
 	//
-	StaticComboNodeHash_t* pByteCodeArray;
-	ShaderInfo_t shaderInfo;
 	{
-		std::lock_guard guard{ Threading::g_mtxGlobal };
-		StaticComboNodeHash_t*& rp	= g_ShaderByteCode[pShaderName]; // Get a static combo pointer, reset it as well
-		pByteCodeArray				= rp;
-		rp							= nullptr;
-		shaderInfo					= g_ShaderToShaderInfo[pShaderName];
+		std::lock_guard guard{ Threading::g_mtxConsole };
+		std::cout << "\r"sv << clr::escaped( lineRewind ) << szShaderFileOperation << " "sv << (bShaderFailed ? clr::red : clr::green) << pShaderName << clr::reset << "..."sv << endLine;
 	}
 
+	CPackedComboWriter& writer	   = pContext->m_Writer;
+	const ShaderInfo_t& shaderInfo = pContext->m_ShaderInfo;
+
 	if ( shaderInfo.m_pShaderName.empty() )
 		return;
 
@@ -557,248 +915,299 @@ static void WriteShaderFiles( std::string_view pShaderName )
 
 	if ( bShaderFailed )
 	{
+		writer.Discard();
 		std::error_code c;
 		fs::remove( path, c );
+		std::lock_guard guard{ Threading::g_mtxConsole };
 		std::cout << "\r"sv << clr::escaped( lineRewind ) << clr::red << pShaderName << clr::reset << " "sv << FormatTimeShort( duration_cast<chrono::seconds>( Clock::now() - lastTime ).count() ) << std::endl;
 		lastTime = Clock::now();
 		return;
 	}
 
-	if ( !pByteCodeArray )
+	if ( writer.Empty() )
 		return;
 
 	if ( g_bVerbose )
+	{
+		std::lock_guard guard{ Threading::g_mtxConsole };
 		std::cout << "\r"sv << std::showbase << pShaderName << ": "sv << clr::green << shaderInfo.m_nTotalShaderCombos << clr::reset << " combos, centroid mask: "sv << clr::green << std::hex << shaderInfo.m_CentroidMask << std::dec << clr::reset << ", numDynamicCombos: "sv << clr::green << shaderInfo.m_nDynamicCombos << clr::reset << std::endl;
+	}
 
-	//
-	// Static combo headers
-	//
-	std::vector<StaticComboAuxInfo_t> StaticComboHeaders;
+	const bool bWritten = writer.WriteVCS( path, shaderInfo );
 
-	StaticComboHeaders.reserve( 1ULL + pByteCodeArray->Count() ); // we know how much ram we need
+	// Finalize, free memory
+	writer.Discard();
 
-	std::vector<size_t> comboIndicesHashedByCRC32[STATIC_COMBO_HASH_SIZE];
-	std::vector<StaticComboAliasRecord_t> duplicateCombos;
+	if ( !bWritten )
+	{
+		pContext->m_bHadError.store( true );
+		std::error_code c;
+		fs::remove( path, c );
+	}
+
+	std::lock_guard guard{ Threading::g_mtxConsole };
+	if ( !bWritten )
+		std::cout << "\r"sv << clr::escaped( lineRewind ) << clr::red << "Couldn't write "sv << path << "!"sv << clr::reset << std::endl;
+	std::cout << "\r"sv << clr::escaped( lineRewind ) << ( bWritten ? clr::green : clr::red ) << pShaderName << clr::reset << " "sv << FormatTimeShort( duration_cast<chrono::seconds>( Clock::now() - lastTime ).count() ) << std::endl;
+	lastTime = Clock::now();
+}
+
+// Until packaging and writing bring the memory in flight under the budget,
+// or another worker moves the cursor off the static combo boundary it is at
+static void WaitForMemoryBudget( const std::atomic<bool>& bBreak, const std::atomic<uint64_t>& iCursor, uint64_t iBoundary )
+{
+	g_nBudgetWaiters.fetch_add( 1 );
+	{
+		std::unique_lock lock{ g_mtxBudget };
+		g_cvBudget.wait( lock, [&] { return g_nBytesInFlight.load() <= g_nMemoryBudget || iCursor.load() != iBoundary || bBreak.load(); } );
+	}
+	g_nBudgetWaiters.fetch_sub( 1 );
+}
+
+// Runs jobs on threads of its own, whoever pushes a job never waits for it.
+// Without threads the job runs in place.
+template <typename TJob>
+class CJobQueue
+{
+public:
+	using Handler = std::function<void( TJob& )>;
+
+	~CJobQueue() { Finish(); }
 
-	// now, lets fill in our combo headers, sort, and write
-	for ( int nChain = 0; nChain < StaticComboNodeHash_t::NumChains; ++nChain )
+	void Start( uint32_t nThreads, std::string_view szName, Handler handler )
 	{
-		for ( CStaticCombo* pStatic = pByteCodeArray->Chain( nChain ).Head(); pStatic; pStatic = pStatic->Next() )
+		m_Handler = std::move( handler );
+		m_bFinish = false;
+
+		m_arrThreads.reserve( nThreads );
+		for ( uint32_t i = 0; i < nThreads; ++i )
+			m_arrThreads.emplace_back( &CJobQueue::Run, this, szName, i );
+	}
+
+	void Push( TJob&& job )
+	{
+		if ( m_arrThreads.empty() )
 		{
-			const CStaticCombo::PackedCode& code = pStatic->Code();
-			if ( code.GetLength() )
-			{
-				StaticComboAuxInfo_t hdr {
-					{
-						.m_nStaticComboID = gsl::narrow<uint32_t>( pStatic->ComboId() ),
-						.m_nFileOffset = 0,
-					},
-					CRC32::ProcessSingleBuffer( code.GetData(), code.GetLength() ),
-					pStatic
-				};
-				const uint32_t nHashIdx = hdr.m_nCRC32 % STATIC_COMBO_HASH_SIZE;
-				__assume( 0 <= nHashIdx && nHashIdx < STATIC_COMBO_HASH_SIZE );
-
-				// now, see if we have an identical static combo
-				auto& hash = comboIndicesHashedByCRC32[nHashIdx];
-				bool bIsDuplicate = false;
-				for ( const size_t i : hash )
-				{
-					const StaticComboAuxInfo_t& check = StaticComboHeaders[i];
-					const CStaticCombo::PackedCode& checkCode = check.m_pByteCode->Code();
-					if ( check.m_nCRC32 == hdr.m_nCRC32 && checkCode.GetLength() == code.GetLength() && memcmp( checkCode.GetData(), code.GetData(), checkCode.GetLength() ) == 0 )
-					{
-						// this static combo is the same as another one!!
-						duplicateCombos.emplace_back( StaticComboAliasRecord_t { hdr.m_nStaticComboID, check.m_nStaticComboID } );
-						bIsDuplicate = true;
-						break;
-					}
-				}
+			m_Handler( job );
+			return;
+		}
 
-				if ( !bIsDuplicate )
-				{
-					StaticComboHeaders.emplace_back( std::move( hdr ) );
-					hash.emplace_back( StaticComboHeaders.size() - 1 );
-				}
-			}
+		{
+			std::lock_guard guard{ m_mtx };
+			m_Jobs.emplace_back( std::move( job ) );
 		}
+		m_cvJobs.notify_one();
 	}
-	// add sentinel key
-	StaticComboHeaders.emplace_back( StaticComboAuxInfo_t { { 0xffffffff, 0 }, 0, nullptr } );
-
-	// now, sort. sentinel key will end up at end
-	std::sort( StaticComboHeaders.begin(), StaticComboHeaders.end(), CompareComboIds );
 
-	//
-	// Shader file stream buffer
-	//
-	std::ofstream ShaderFile( path, std::ios::binary | std::ios::trunc ); // Streaming buffer for vcs file (since this can blow memory)
+	// Runs all the jobs pushed so far, then stops the threads
+	void Finish()
+	{
+		{
+			std::lock_guard guard{ m_mtx };
+			m_bFinish = true;
+		}
+		m_cvJobs.notify_all();
 
-	// ------ Header --------------
-	const ShaderHeader_t header {
-		SHADER_VCS_VERSION_NUMBER,
-		gsl::narrow_cast<int32_t>( shaderInfo.m_nTotalShaderCombos ), // this is not actually used in vertexshaderdx8.cpp for combo checking
-		gsl::narrow<int32_t>( shaderInfo.m_nDynamicCombos ),          // this is used
-		0,
-		shaderInfo.m_CentroidMask,
-		gsl::narrow<uint32_t>( StaticComboHeaders.size() ),
-		shaderInfo.m_Crc32
-	};
-	ShaderFile.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+		std::for_each( m_arrThreads.begin(), m_arrThreads.end(), []( std::thread& t ) { if ( t.joinable() ) t.join(); } );
+		m_arrThreads.clear();
+	}
 
-	// static combo dictionary
-	const auto nDictionaryOffset = ShaderFile.tellp();
+private:
+	void Run( std::string_view szName, uint32_t id )
+	{
+		char threadName[16];
+		snprintf( threadName, sizeof( threadName ), "%.*s #%u", static_cast<int>( szName.size() ), szName.data(), id );
+		Platform::SetCurrentThreadName( threadName );
 
-	// we will re write this one we know the offsets
-	ShaderFile.write( reinterpret_cast<const char*>( StaticComboHeaders.data() ), sizeof( StaticComboRecord_t ) * StaticComboHeaders.size() ); // dummy write, 8 bytes per static combo
+		std::unique_lock lock{ m_mtx };
+		for ( ;; )
+		{
+			m_cvJobs.wait( lock, [this] { return !m_Jobs.empty() || m_bFinish; } );
+			if ( m_Jobs.empty() )
+				return;
 
-	const uint32_t dupl = gsl::narrow<uint32_t>( duplicateCombos.size() );
-	ShaderFile.write( reinterpret_cast<const char*>( &dupl ), sizeof( dupl ) );
+			TJob job = std::move( m_Jobs.front() );
+			m_Jobs.pop_front();
 
-	// now, write out all duplicate header records
-	// sort duplicate combo records for binary search
-	std::sort( duplicateCombos.begin(), duplicateCombos.end(), CompareDupComboIndices );
+			lock.unlock();
+			m_Handler( job );
+			lock.lock();
+		}
+	}
 
-	ShaderFile.write( reinterpret_cast<const char*>( duplicateCombos.data() ), sizeof( StaticComboAliasRecord_t ) * duplicateCombos.size() );
+	Handler m_Handler;
+	std::mutex m_mtx;
+	std::condition_variable m_cvJobs;
+	std::deque<TJob> m_Jobs;
+	bool m_bFinish = false;
+	std::vector<std::thread> m_arrThreads;
+};
 
-	// now, write out all static combos
-	for ( StaticComboRecord_t& SRec : StaticComboHeaders )
+// Compresses the blocks of one static combo side by side. Helpers pick up
+// blocks next to the packaging thread, which takes blocks itself as well and so
+// never waits on helpers busy with another static combo.
+class CBlockCompressor
+{
+public:
+	void Start( uint32_t nThreads )
 	{
-		SRec.m_nFileOffset = gsl::narrow<uint32_t>( ShaderFile.tellp() );
-		if ( SRec.m_nStaticComboID != 0xffffffff ) // sentinel key?
-		{
-			CStaticCombo* pStatic = pByteCodeArray->FindByKey( SRec.m_nStaticComboID );
-			Assert( pStatic );
+		m_nHelpers = nThreads;
+		m_Helpers.Start( nThreads, "Compressor"sv, []( std::shared_ptr<Batch>& pBatch ) { pBatch->Run(); } );
+	}
 
-			// Put the packed chunk of code for this static combo
-			if ( const auto& code = pStatic->Code() )
-				ShaderFile.write( reinterpret_cast<const char*>( code.GetData() ), code.GetLength() );
+	void Finish() { m_Helpers.Finish(); }
 
-			constexpr uint32_t endMark = 0xffffffff; // end of dynamic combos
-			ShaderFile.write( reinterpret_cast<const char*>( &endMark ), sizeof( endMark ) );
+	void Compress( const uint8_t* pDynamicCombos, std::vector<DynamicComboBlock_t>& arrBlocks )
+	{
+		if ( !m_nHelpers || arrBlocks.size() < 2 || g_bNoCompress )
+		{
+			for ( DynamicComboBlock_t& block : arrBlocks )
+				CompressBlock( pDynamicCombos, block );
+			return;
 		}
+
+		auto pBatch = std::make_shared<Batch>( pDynamicCombos, arrBlocks );
+		for ( size_t i = 0, nHelpers = std::min<size_t>( m_nHelpers, arrBlocks.size() - 1 ); i < nHelpers; ++i )
+			m_Helpers.Push( std::shared_ptr( pBatch ) );
+		pBatch->Run();
+		pBatch->Wait();
 	}
 
-	//
-	// Re-writing the combo header
-	//
-	ShaderFile.seekp( nDictionaryOffset, std::ios::beg );
+private:
+	struct Batch
+	{
+		Batch( const uint8_t* pDynamicCombos, std::vector<DynamicComboBlock_t>& arrBlocks ) noexcept
+			: m_pDynamicCombos( pDynamicCombos ), m_arrBlocks( arrBlocks ), m_nBlocksLeft( arrBlocks.size() ) {}
 
-	// now, rewrite header. data is already byte-swapped appropriately
-	for ( const StaticComboRecord_t& SRec : StaticComboHeaders )
-		ShaderFile.write( reinterpret_cast<const char*>( &SRec ), sizeof( StaticComboRecord_t ) );
+		void Run()
+		{
+			// Helpers late to the batch only see the index past the end, the blocks may be gone by then
+			for ( size_t i; ( i = m_nNextBlock.fetch_add( 1, std::memory_order_relaxed ) ) < m_arrBlocks.size(); )
+			{
+				CompressBlock( m_pDynamicCombos, m_arrBlocks[i] );
+				if ( m_nBlocksLeft.fetch_sub( 1, std::memory_order_acq_rel ) == 1 )
+				{
+					std::lock_guard guard{ m_mtx };
+					m_cvDone.notify_all();
+				}
+			}
+		}
 
-	ShaderFile.close();
+		void Wait()
+		{
+			std::unique_lock lock{ m_mtx };
+			m_cvDone.wait( lock, [this] { return m_nBlocksLeft.load( std::memory_order_acquire ) == 0; } );
+		}
 
-	// Finalize, free memory
-	delete pByteCodeArray;
+		const uint8_t* const m_pDynamicCombos;
+		std::span<DynamicComboBlock_t> m_arrBlocks;
+		std::atomic<size_t> m_nNextBlock{ 0 };
+		std::atomic<size_t> m_nBlocksLeft;
+		std::mutex m_mtx;
+		std::condition_variable m_cvDone;
+	};
 
-	std::cout << "\r"sv << clr::escaped( lineRewind ) << clr::green << pShaderName << clr::reset << " "sv << FormatTimeShort( duration_cast<chrono::seconds>( Clock::now() - lastTime ).count() ) << std::endl;
-	lastTime = Clock::now();
-}
+	uint32_t m_nHelpers = 0;
+	CJobQueue<std::shared_ptr<Batch>> m_Helpers;
+};
 
-// Assemble a reply package to the master from the compiled bytecode
-// return the length of the package.
-static size_t AssembleWorkerReplyPackage( const CfgProcessor::CfgEntryInfo* pEntry, uint64_t nComboOfEntry, CUtlBuffer& pBuf )
+// Packs the compiled bytecode of a finished static combo into compressed blocks.
+// Returns the static combo with its packed code, null if it has no code to write.
+[[nodiscard]] static std::unique_ptr<CStaticCombo> PackStaticCombo( const CfgProcessor::CfgEntryInfo* pEntry, std::unique_ptr<CStaticCombo> pStComboRec, CBlockCompressor& compressor )
 {
-	CStaticCombo* pStComboRec;
-	StaticComboNodeHash_t* pByteCodeArray;
-	{
-		std::lock_guard guard{ Threading::g_mtxGlobal };
-		pStComboRec    = StaticComboFromDict( pEntry->m_szName, nComboOfEntry );
-		pByteCodeArray = g_ShaderByteCode[pEntry->m_szName];
-	}
-
-	size_t nBytesWritten = 0;
+	// All commands of the static combo are finished, nobody else touches it now
+	ShaderCompileContext* const pContext = pEntry->m_pContext;
 
-	if ( pStComboRec && !pStComboRec->DynamicCombos().empty() )
+	if ( !pStComboRec->DynamicCombos().empty() )
 	{
 		CUtlBuffer ubDynamicComboBuffer;
+		std::vector<DynamicComboBlock_t> arrBlocks;
 
 		pStComboRec->SortDynamicCombos();
 		// iterate over all dynamic combos.
-		for ( const auto& combo : pStComboRec->DynamicCombos() )
+		for ( const CByteCodeBlock& code : pStComboRec->DynamicCombos() )
+		{
+			OutputDynamicCombo( arrBlocks, ubDynamicComboBuffer, code.m_nComboID,
+								gsl::narrow<uint32_t>( code.m_nCodeSize ), code.m_pCode );
+		}
+
+		// The packed code goes into the same static combo, the bytecode goes away in one go
+		pStComboRec->ReleaseByteCode();
+
+		const uint8_t* pDynamicCombos = reinterpret_cast<const uint8_t*>( ubDynamicComboBuffer.Base() );
+		compressor.Compress( pDynamicCombos, arrBlocks );
+
+		size_t nBytesWritten = 0;
+		for ( const DynamicComboBlock_t& block : arrBlocks )
+			nBytesWritten += GetPackedBlockSize( block );
+
+		if ( uint8_t* pCodeBuffer = pStComboRec->AllocPackedCodeBlock( nBytesWritten ) )
 		{
-			CByteCodeBlock* pCode = combo.get();
-			// check if we have already output an identical combo
-			OutputDynamicCombo( nBytesWritten, ubDynamicComboBuffer, pBuf, pCode->m_nComboID,
-								gsl::narrow<uint32_t>( pCode->m_nCodeSize ), pCode->get() );
+			for ( const DynamicComboBlock_t& block : arrBlocks )
+				pCodeBuffer = PutPackedBlock( pCodeBuffer, pDynamicCombos, block );
 		}
-		FlushCombos( nBytesWritten, ubDynamicComboBuffer, pBuf );
 	}
 
-	// Time to limit amount of prints
-	static Clock::time_point s_fLastInfoTime;
-	static uint64_t s_nLastEntry = nComboOfEntry;
+	const uint64_t nPendingCombos = g_nPendingCombos.load( std::memory_order_relaxed );
+
+	// Time to limit amount of prints. Whoever gets to print does, the others
+	// carry on packaging instead of waiting for the console.
+	static std::atomic<Clock::rep> s_nNextInfoTime;
+	static uint64_t s_nLastPending = nPendingCombos;
 	static CUtlMovingAverage<uint64_t, 60> s_averageProcess;
-	static std::string_view s_lastShader = pEntry->m_szName;
 	const Clock::time_point fCurTime = Clock::now();
 
+	if ( fCurTime.time_since_epoch().count() >= s_nNextInfoTime.load( std::memory_order_relaxed ) )
 	{
-		std::lock_guard guard{ Threading::g_mtxGlobal };
-		if ( pStComboRec )
-		{
-			CStaticCombo *pCombo = pByteCodeArray->FindByKey( nComboOfEntry );
-			pByteCodeArray->DeleteByKey( nComboOfEntry );
-			delete pCombo;
-		}
-		if ( duration_cast<chrono::seconds>( fCurTime - s_fLastInfoTime ).count() != 0 )
+		std::unique_lock lock{ Threading::g_mtxConsole, std::try_to_lock };
+		if ( lock && fCurTime.time_since_epoch().count() >= s_nNextInfoTime.load( std::memory_order_relaxed ) )
 		{
-			if ( s_lastShader.data() != pEntry->m_szName.data() )
-			{
-				s_averageProcess.Reset();
-				s_lastShader = pEntry->m_szName;
-				s_nLastEntry = nComboOfEntry;
-			}
-
-			s_averageProcess.PushValue( s_nLastEntry - nComboOfEntry );
-			s_nLastEntry = nComboOfEntry;
+			// Prints are a second or more apart, and the packaging can run ahead of the print
+			s_averageProcess.PushValue( s_nLastPending > nPendingCombos ? s_nLastPending - nPendingCombos : 0 );
+			s_nLastPending = nPendingCombos;
 			const auto avg = s_averageProcess.GetAverage();
-			std::cout << "\r"sv << clr::escaped( lineRewind ) << "Compiling "sv << ( g_ShaderHadError.contains( pEntry->m_szName ) ? clr::red : clr::green ) << pEntry->m_szName << clr::reset << " ["sv << clr::blue << PrettyPrint( nComboOfEntry ) << clr::reset << " remaining] "sv
-				<< FormatTimeShort( duration_cast<chrono::seconds>( fCurTime - g_flStartTime ).count() ) << " elapsed ("sv << clr::green2 << avg << clr::reset << " c/s, est. remaining "sv << FormatTimeShort( nComboOfEntry / std::max<uint64_t>( avg, 1 ) ) << ")"sv << endLine;
-			s_fLastInfoTime = fCurTime;
+			const uint64_t nBytesInFlight = g_nBytesInFlight.load( std::memory_order_relaxed );
+			std::cout << "\r"sv << clr::escaped( lineRewind ) << "Compiling "sv << ( pContext->m_bHadError.load( std::memory_order_relaxed ) ? clr::red : clr::green ) << pEntry->m_szName << clr::reset << ( g_bPendingCombosExact ? " ["sv : " [up to "sv ) << clr::blue << PrettyPrint( nPendingCombos ) << clr::reset << " remaining] "sv
+				<< FormatTimeShort( duration_cast<chrono::seconds>( fCurTime - g_flStartTime ).count() ) << " elapsed ("sv << clr::green2 << avg << clr::reset << " c/s, est. remaining "sv << FormatTimeShort( nPendingCombos / std::max<uint64_t>( avg, 1 ) ) << ", "sv
+				<< ( g_nMemoryBudget && nBytesInFlight > g_nMemoryBudget ? clr::red : clr::green2 ) << ( nBytesInFlight >> 20 ) << clr::reset << " MB in flight)"sv << endLine;
+			s_nNextInfoTime.store( ( fCurTime + chrono::seconds( 1 ) ).time_since_epoch().count(), std::memory_order_relaxed );
 		}
 	}
 
-	return nBytesWritten;
+	if ( !pStComboRec->Code() )
+		pStComboRec.reset();
+	return pStComboRec;
 }
 
 template <typename TMutexType>
 class CWorkerAccumState
 {
 public:
-	explicit CWorkerAccumState( uint32_t iFlags ) noexcept
-		: m_iFirstCommand( 0 ), m_iNextCommand( 0 ), m_iEndCommand( 0 )
-		, m_iLastFinished( 0 ), m_hCombo( nullptr ), m_iFlags( iFlags ) {}
+	explicit CWorkerAccumState( Compiler::ICompilerBackend& backend, uint32_t iFlags, uint32_t nPackThreads ) noexcept
+		: m_nWorkers( 0 ), m_iNextCommand( 0 ), m_iEndCommand( 0 )
+		, m_nPackThreads( nPackThreads ), m_Backend( backend ), m_iFlags( iFlags ) {}
 
 	void RangeBegin( uint64_t iFirstCommand, uint64_t iEndCommand );
 	void RangeFinished();
 
-	void ExecuteCompileCommand( CfgProcessor::ComboHandle hCombo );
+	void ExecuteCompileCommand( CfgProcessor::ComboHandle hCombo, CfgProcessor::ComboBuildCommand& command );
 	void HandleCommandResponse( CfgProcessor::ComboHandle hCombo, std::unique_ptr<CmdSink::IResponse> &&pResponse );
 
+	// The same workers run through every shader of the range. Complete static
+	// combos go to the packaging threads, then on to the writer threads, which
+	// store them and write out finished shaders.
 	void Run( uint32_t i )
 	{
-		m_arrSubProcessInfos.reserve( i );
+		m_nWorkers = i;
 
 		std::vector<std::thread> threads;
 		threads.reserve( i );
 
 		while ( i-- > 0 )
-		{
-			++m_nActive;
 			threads.emplace_back( DoExecute, this, i );
-		}
-
-		constexpr const std::chrono::milliseconds sleepTime{ 250 };
-		while ( m_nActive )
-		{
-			_mm_pause();
-			std::this_thread::sleep_for( sleepTime );
-		}
 
 		std::for_each( threads.begin(), threads.end(), []( std::thread& t ) { if ( t.joinable() ) t.join(); } );
-		m_arrSubProcessInfos.clear();
+		m_nWorkers = 0;
 	}
 
 	void OnProcessST();
@@ -806,12 +1215,11 @@ public:
 	void Stop() noexcept
 	{
 		m_bBreak.store( true, std::memory_order_release );
+		NotifyBudgetWaiters();
 	}
 
 private:
 	std::atomic<bool>			m_bBreak;
-	std::atomic<int>			m_nActive;
-	TMutexType					m_Mutex;
 
 	static void DoExecute( CWorkerAccumState* pThis, uint32_t workerId )
 	{
@@ -819,53 +1227,73 @@ private:
 
 		while ( pThis->OnProcess() )
 			continue;
-
-		--pThis->m_nActive;
 	}
 
 	static void SetThreadName( uint32_t workerId )
 	{
-		wchar_t workerName[16];
-		swprintf_s(workerName, L"Worker #%u", workerId);
+		char workerName[16];
+		snprintf( workerName, sizeof( workerName ), "Worker #%u", workerId );
 
-		SetThreadDescription( GetCurrentThread(), workerName );
+		Platform::SetCurrentThreadName( workerName );
 	}
 
-	std::vector<uint64_t>	m_arrSubProcessInfos;
-	uint64_t				m_iFirstCommand;
-	uint64_t				m_iNextCommand;
+	uint32_t				m_nWorkers;
+
+	std::atomic<uint64_t>	m_iNextCommand; // chunk cursor, workers claim commands from here
 	uint64_t				m_iEndCommand;
 
-	uint64_t				m_iLastFinished;
+	struct PackagingJob
+	{
+		const CfgProcessor::CfgEntryInfo* m_pEntry;
+		std::unique_ptr<CStaticCombo> m_pStaticCombo;
+	};
+	const uint32_t			m_nPackThreads;
+	CJobQueue<PackagingJob>	m_Packaging;
+	CBlockCompressor		m_Compressor;
 
-	CfgProcessor::ComboHandle m_hCombo;
+	// Packed static combo, null if it had nothing to write. Its last command finishes once
+	// it is stored, a job without commands comes from whoever finished the shader otherwise.
+	struct WritingJob
+	{
+		const CfgProcessor::CfgEntryInfo* m_pEntry;
+		std::unique_ptr<CStaticCombo> m_pStaticCombo;
+		uint64_t m_nCommands;
+	};
+	CJobQueue<WritingJob>	m_Writing;
 
+	Compiler::ICompilerBackend& m_Backend;
 	const uint32_t			m_iFlags;
 
 	bool OnProcess();
-	void TryToPackageData( uint64_t iCommandNumber );
+	uint64_t GetChunkSize( uint64_t nPreferred ) const noexcept;
+	void FinishSkippedCommands( uint64_t iBegin, uint64_t iEnd );
+	void FinishStaticComboCommands( const CfgProcessor::CfgEntryInfo* pEntry, uint64_t nStComboIdx, CStaticCombo* pStaticCombo, uint64_t nCommands );
+	void FinishShaderCommands( const CfgProcessor::CfgEntryInfo* pEntry, uint64_t nCommands );
+	void PackageStaticCombo( PackagingJob& job );
+	void WriteStaticCombo( WritingJob& job );
 };
 
 template <typename TMutexType>
 void CWorkerAccumState<TMutexType>::RangeBegin( uint64_t iFirstCommand, uint64_t iEndCommand )
 {
-	m_iFirstCommand = iFirstCommand;
-	m_iNextCommand  = iFirstCommand;
+	m_iNextCommand.store( iFirstCommand, std::memory_order_relaxed );
 	m_iEndCommand   = iEndCommand;
-	m_iLastFinished = iFirstCommand;
-	m_hCombo        = nullptr;
-	CfgProcessor::Combo_GetNext( m_iNextCommand, m_hCombo, m_iEndCommand );
+	m_Writing.Start( m_nPackThreads, "Writer"sv, [this]( WritingJob& job ) { WriteStaticCombo( job ); } );
+	m_Compressor.Start( m_nPackThreads );
+	m_Packaging.Start( m_nPackThreads, "Packer"sv, [this]( PackagingJob& job ) { PackageStaticCombo( job ); } );
 }
 
 template <typename TMutexType>
 void CWorkerAccumState<TMutexType>::RangeFinished()
 {
-	// Finish packaging data
-	TryToPackageData( m_iEndCommand - 1 );
+	// Finish packaging the static combos queued so far, then writing them
+	m_Packaging.Finish();
+	m_Compressor.Finish();
+	m_Writing.Finish();
 }
 
 template <typename TMutexType>
-void CWorkerAccumState<TMutexType>::ExecuteCompileCommand( CfgProcessor::ComboHandle hCombo )
+void CWorkerAccumState<TMutexType>::ExecuteCompileCommand( CfgProcessor::ComboHandle hCombo, CfgProcessor::ComboBuildCommand& command )
 {
 	if constexpr ( std::is_same_v<TMutexType, Threading::null_mutex> )
 	{
@@ -877,7 +1305,8 @@ void CWorkerAccumState<TMutexType>::ExecuteCompileCommand( CfgProcessor::ComboHa
 		}
 	}
 
-	std::unique_ptr<CmdSink::IResponse> response = Compiler::ExecuteCommand( Combo_BuildCommand( hCombo ), m_iFlags );
+	Combo_BuildCommand( hCombo, command );
+	std::unique_ptr<CmdSink::IResponse> response = m_Backend.ExecuteCommand( command, m_iFlags );
 
 	HandleCommandResponse( hCombo, std::move( response ) );
 }
@@ -892,18 +1321,19 @@ void CWorkerAccumState<TMutexType>::HandleCommandResponse( CfgProcessor::ComboHa
 	const uint64_t iComboIndex                   = Combo_GetComboNum( hCombo );
 	const uint64_t iCommandNumber                = Combo_GetCommandNum( hCombo );
 
+	ShaderCompileContext* const pContext         = pEntryInfo->m_pContext;
+
+	const uint64_t nStComboIdx                   = iComboIndex / pEntryInfo->m_numDynamicCombos;
+	CStaticCombo* const pStaticCombo             = StaticComboFromDictAdd( pEntryInfo, nStComboIdx );
+
 	if ( pResponse && pResponse->Succeeded() )
 	{
-		std::lock_guard guard{ Threading::g_mtxGlobal };
-		const uint64_t nStComboIdx = iComboIndex / pEntryInfo->m_numDynamicCombos;
 		const uint64_t nDyComboIdx = iComboIndex - ( nStComboIdx * pEntryInfo->m_numDynamicCombos );
-		StaticComboFromDictAdd( pEntryInfo->m_szName, nStComboIdx )->AddDynamicCombo( nDyComboIdx, pResponse->GetResultBuffer(), pResponse->GetResultBufferLen() );
+		pStaticCombo->AddDynamicCombo( nDyComboIdx, pResponse->GetResultBuffer(), pResponse->GetResultBufferLen() );
 	}
 	else // Tell the master that this shader failed
-	{
-		std::lock_guard guard{ Threading::g_mtxGlobal };
-		ShaderHadErrorDispatchInt( pEntryInfo->m_szName );
-	}
+		pContext->m_bHadError.store( true );
+	g_nPendingCombos.fetch_sub( 1, std::memory_order_relaxed );
 
 	// Process listing even if the shader succeeds for warnings
 	const char* szListing = pResponse ? pResponse->GetListing() : "Out of memory when allocating compilation result.";
@@ -919,141 +1349,200 @@ void CWorkerAccumState<TMutexType>::HandleCommandResponse( CfgProcessor::ComboHa
 		char chBuffer[4096];
 		Combo_FormatCommandHumanReadable( hCombo, chBuffer );
 
-		ErrMsgDispatchMsgLine( chBuffer, szListing, pEntryInfo->m_szName );
+		ErrMsgDispatchMsgLine( chBuffer, szListing, pContext );
 		if ( ( !pResponse || !pResponse->Succeeded() ) && g_bFastFail )
 			StopCommandRange();
 	}
 
-	// Maybe zip things up
-	TryToPackageData( iCommandNumber );
+	FinishStaticComboCommands( pEntryInfo, nStComboIdx, pStaticCombo, 1 );
 }
 
+// Counting every command, skipped ones included, tells exactly when static combos and
+// shaders are complete, whether the counts of combos left after SKIP are exact or not.
 template <typename TMutexType>
-void CWorkerAccumState<TMutexType>::TryToPackageData( uint64_t iCommandNumber )
+void CWorkerAccumState<TMutexType>::FinishSkippedCommands( uint64_t iBegin, uint64_t iEnd )
 {
-	std::unique_lock guard{ m_Mutex };
-
-	uint64_t iFinishedByNow = iCommandNumber + 1;
+	const CfgProcessor::CfgEntryInfo* pSkippedEntry = nullptr;
+	uint64_t nSkipped = 0;
 
-	// Check if somebody is running an earlier command
-	for ( const auto& iRunningCommand : m_arrSubProcessInfos )
+	for ( uint64_t iCommand = iBegin, iRunEnd; iCommand < iEnd; iCommand = iRunEnd )
 	{
-		if ( iRunningCommand < iCommandNumber )
+		iRunEnd = std::min( CfgProcessor::GetStaticComboEnd( iCommand ), iEnd );
+		const CfgProcessor::CfgEntryInfo* pEntry = CfgProcessor::GetCommandEntry( iCommand );
+		if ( !pEntry )
+			continue;
+
+		if ( pEntry != pSkippedEntry )
 		{
-			iFinishedByNow = 0;
-			break;
+			FinishShaderCommands( pSkippedEntry, std::exchange( nSkipped, 0 ) );
+			pSkippedEntry = pEntry;
+		}
+
+		// Static combos skipped as a whole never had anything to package
+		const uint64_t nCommands = iRunEnd - iCommand;
+		if ( nCommands == pEntry->m_numDynamicCombos )
+		{
+			nSkipped += nCommands;
+			continue;
 		}
+
+		// Commands go from the last combo down
+		const uint64_t nStComboIdx = ( pEntry->m_iCommandEnd - 1 - iCommand ) / pEntry->m_numDynamicCombos;
+		FinishStaticComboCommands( pEntry, nStComboIdx, StaticComboFromDictAdd( pEntry, nStComboIdx ), nCommands );
 	}
 
-	const uint64_t iLastFinished = m_iLastFinished;
-	if ( iFinishedByNow > m_iLastFinished )
+	FinishShaderCommands( pSkippedEntry, nSkipped );
+}
+
+template <typename TMutexType>
+void CWorkerAccumState<TMutexType>::FinishStaticComboCommands( const CfgProcessor::CfgEntryInfo* pEntry, uint64_t nStComboIdx, CStaticCombo* pStaticCombo, uint64_t nCommands )
+{
+	if ( !pStaticCombo->FinishCommands( nCommands ) )
 	{
-		m_iLastFinished = iFinishedByNow;
-		guard.unlock();
-	}
-	else
+		FinishShaderCommands( pEntry, nCommands );
 		return;
+	}
 
-	CfgProcessor::ComboHandle hChBegin = CfgProcessor::Combo_GetCombo( iLastFinished );
-	CfgProcessor::ComboHandle hChEnd   = CfgProcessor::Combo_GetCombo( iFinishedByNow );
+	// The last command of the static combo hands it over to packaging, it finishes once stored
+	FinishShaderCommands( pEntry, nCommands - 1 );
+	m_Packaging.Push( PackagingJob{ pEntry, StaticComboFromDictRemove( pEntry->m_pContext, nStComboIdx ) } );
+}
 
-	Assert( hChBegin && hChEnd );
+template <typename TMutexType>
+void CWorkerAccumState<TMutexType>::FinishShaderCommands( const CfgProcessor::CfgEntryInfo* pEntry, uint64_t nCommands )
+{
+	// Whoever finishes the last command of the shader has it written, static combos are all stored by then
+	if ( nCommands && pEntry->m_pContext->m_nCommandsLeft.fetch_sub( nCommands, std::memory_order_acq_rel ) == nCommands )
+		m_Writing.Push( WritingJob{ pEntry, nullptr, 0 } );
+}
 
-	const CfgProcessor::CfgEntryInfo* pInfoBegin = Combo_GetEntryInfo( hChBegin );
-	const CfgProcessor::CfgEntryInfo* pInfoEnd   = Combo_GetEntryInfo( hChEnd );
+template <typename TMutexType>
+void CWorkerAccumState<TMutexType>::PackageStaticCombo( PackagingJob& job )
+{
+	// Nothing gets written once stopped
+	if ( m_bBreak.load( std::memory_order_acquire ) )
+		return;
 
-	uint64_t nComboBegin     = Combo_GetComboNum( hChBegin ) / pInfoBegin->m_numDynamicCombos;
-	const uint64_t nComboEnd = Combo_GetComboNum( hChEnd ) / pInfoEnd->m_numDynamicCombos;
+	m_Writing.Push( WritingJob{ job.m_pEntry, PackStaticCombo( job.m_pEntry, std::move( job.m_pStaticCombo ), m_Compressor ), 1 } );
+}
 
-	for ( ; pInfoBegin && ( pInfoBegin->m_iCommandStart < pInfoEnd->m_iCommandStart || nComboBegin > nComboEnd ); )
-	{
-		// Zip this combo
-		CUtlBuffer mbPacked;
-		const size_t nPackedLength = AssembleWorkerReplyPackage( pInfoBegin, nComboBegin, mbPacked );
+template <typename TMutexType>
+void CWorkerAccumState<TMutexType>::WriteStaticCombo( WritingJob& job )
+{
+	if ( m_bBreak.load( std::memory_order_acquire ) )
+		return;
 
-		if ( nPackedLength )
-		{
-			// Packed buffer
-			uint8_t* pCodeBuffer;
-			{
-				std::lock_guard guard_static_combo{ Threading::g_mtxGlobal };
-				pCodeBuffer = StaticComboFromDictAdd( pInfoBegin->m_szName, nComboBegin )->AllocPackedCodeBlock( nPackedLength );
-			}
+	ShaderCompileContext* const pContext = job.m_pEntry->m_pContext;
+	if ( job.m_pStaticCombo && !pContext->m_Writer.Append( pContext->m_ShaderInfo, std::move( job.m_pStaticCombo ) ) )
+		pContext->m_bHadError.store( true, std::memory_order_relaxed );
 
-			if ( pCodeBuffer )
-			{
-				mbPacked.SeekGet( CUtlBuffer::SEEK_HEAD, 0 );
-				mbPacked.Get( pCodeBuffer, gsl::narrow<int>( nPackedLength ) );
-			}
-		}
+	// Static combos can be stored by several threads at once,
+	// only the one finishing the last command writes the shader.
+	if ( job.m_nCommands && pContext->m_nCommandsLeft.fetch_sub( job.m_nCommands, std::memory_order_acq_rel ) != job.m_nCommands )
+		return;
 
-		// Next iteration
-		if ( !nComboBegin-- )
-		{
-			Combo_Free( hChBegin );
-			if ( ( hChBegin = CfgProcessor::Combo_GetCombo( pInfoBegin->m_iCommandEnd ) ) != nullptr )
-			{
-				pInfoBegin  = Combo_GetEntryInfo( hChBegin );
-				nComboBegin = pInfoBegin->m_numStaticCombos - 1;
-			}
-		}
-	}
+	if ( m_bBreak.load( std::memory_order_acquire ) )
+		return;
+
+	WriteShaderFiles( pContext );
+}
 
-	Combo_Free( hChBegin );
-	Combo_Free( hChEnd );
+template <typename TMutexType>
+uint64_t CWorkerAccumState<TMutexType>::GetChunkSize( uint64_t nPreferred ) const noexcept
+{
+	// Guided scheduling: never claim more than a fraction of what is left,
+	// so the last commands are spread over all workers
+	const uint64_t iNextCommand = m_iNextCommand.load( std::memory_order_relaxed );
+	const uint64_t nRemaining   = iNextCommand < m_iEndCommand ? m_iEndCommand - iNextCommand : 0;
+	return std::clamp<uint64_t>( nRemaining / ( 4ULL * m_nWorkers ), 1, nPreferred );
 }
 
 template <typename TMutexType>
 bool CWorkerAccumState<TMutexType>::OnProcess()
 {
-	CfgProcessor::ComboHandle hThreadCombo;
-	uint64_t* iCurrentId;
-	{
-		std::lock_guard guard{ m_Mutex };
-		hThreadCombo = m_hCombo ? Combo_Alloc( m_hCombo ) : nullptr;
-		m_arrSubProcessInfos.resize( m_arrSubProcessInfos.size() + 1 );
-		iCurrentId = &m_arrSubProcessInfos.back();
-	}
+	// Chunks grow while they take less than this, so fast or mostly skipped
+	// combos don't hit the cursor every time, and slow compiles go one by one.
+	constexpr auto targetChunkTime = std::chrono::microseconds( 500 );
+	constexpr uint64_t nMaxChunkSize = 256;
 
-	uint64_t iThreadCommand = ~0ULL;
+	uint64_t nChunkSize = 1;
+	CfgProcessor::ComboBuildCommand command;
 
-	for ( ;; )
+	while ( !m_bBreak.load( std::memory_order_acquire ) )
 	{
+		uint64_t nClaim		 = GetChunkSize( nChunkSize );
+		uint64_t iChunkBegin = m_iNextCommand.load();
+		if ( iChunkBegin >= m_iEndCommand )
+			break;
+		if ( g_nMemoryBudget && g_nBytesInFlight.load( std::memory_order_relaxed ) > g_nMemoryBudget )
 		{
-			std::lock_guard guard{ m_Mutex };
-			if ( m_hCombo )
-			{
-				Combo_Assign( hThreadCombo, m_hCombo );
-				*iCurrentId = Combo_GetCommandNum( hThreadCombo );
-				Combo_GetNext( iThreadCommand, m_hCombo, m_iEndCommand );
-			}
-			else
+			// Over the memory budget only the static combos already started get more commands,
+			// all of their commands are claimed in order so they complete and free their bytecode
+			if ( !iChunkBegin || CfgProcessor::GetStaticComboEnd( iChunkBegin - 1 ) == iChunkBegin )
 			{
-				Combo_Free( hThreadCombo );
-				iThreadCommand = ~0ULL;
-				*iCurrentId = ~0ULL;
+				WaitForMemoryBudget( m_bBreak, m_iNextCommand, iChunkBegin );
+				continue;
 			}
+			nClaim = std::min( nClaim, CfgProcessor::GetStaticComboEnd( iChunkBegin ) - iChunkBegin );
 		}
+		if ( !m_iNextCommand.compare_exchange_weak( iChunkBegin, iChunkBegin + nClaim ) )
+			continue;
+		// Waiters at the boundary may now help with the static combo just started
+		NotifyBudgetWaiters();
+		const uint64_t iChunkEnd = std::min( iChunkBegin + nClaim, m_iEndCommand );
+
+		const Clock::time_point chunkStart = Clock::now();
+
+		// Decode the combos of the chunk locally, the skipped ones
+		// up to a compiled combo are finished along with it
+		uint64_t iFinishedBegin                = iChunkBegin;
+		uint64_t iThreadCommand                = iChunkBegin;
+		CfgProcessor::ComboHandle hThreadCombo = nullptr;
+		CfgProcessor::Combo_GetNext( iThreadCommand, hThreadCombo, iChunkEnd );
+		while ( hThreadCombo && !m_bBreak.load( std::memory_order_acquire ) )
+		{
+			ExecuteCompileCommand( hThreadCombo, command );
+			FinishSkippedCommands( iFinishedBegin, iThreadCommand );
+			iFinishedBegin = iThreadCommand + 1;
+			CfgProcessor::Combo_GetNext( iThreadCommand, hThreadCombo, iChunkEnd );
+		}
+		Combo_Free( hThreadCombo );
 
-		if ( hThreadCombo && !m_bBreak.load( std::memory_order_acquire ) )
-			ExecuteCompileCommand( hThreadCombo );
-		else
-			break;
+		if ( iFinishedBegin < iChunkEnd && !m_bBreak.load( std::memory_order_acquire ) )
+			FinishSkippedCommands( iFinishedBegin, iChunkEnd );
+
+		const auto chunkTime = Clock::now() - chunkStart;
+		if ( chunkTime < targetChunkTime && nClaim == nChunkSize )
+			nChunkSize = std::min( nChunkSize * 2, nMaxChunkSize );
+		else if ( chunkTime > targetChunkTime * 4 )
+			nChunkSize = std::max<uint64_t>( nChunkSize / 2, 1 );
 	}
 
-	Combo_Free( hThreadCombo );
 	return false;
 }
 
 template <typename TMutexType>
 void CWorkerAccumState<TMutexType>::OnProcessST()
 {
-	while ( m_hCombo && !m_bBreak.load( std::memory_order_acquire ) )
+	uint64_t iFinishedBegin          = m_iNextCommand.load( std::memory_order_relaxed );
+	uint64_t iCommand                = iFinishedBegin;
+	CfgProcessor::ComboHandle hCombo = nullptr;
+	CfgProcessor::ComboBuildCommand command;
+	CfgProcessor::Combo_GetNext( iCommand, hCombo, m_iEndCommand );
+
+	while ( hCombo && !m_bBreak.load( std::memory_order_acquire ) )
 	{
-		ExecuteCompileCommand( m_hCombo );
+		ExecuteCompileCommand( hCombo, command );
+		FinishSkippedCommands( iFinishedBegin, iCommand );
+		iFinishedBegin = iCommand + 1;
 
-		Combo_GetNext( m_iNextCommand, m_hCombo, m_iEndCommand );
+		Combo_GetNext( iCommand, hCombo, m_iEndCommand );
 	}
+
+	Combo_Free( hCombo );
+
+	if ( iFinishedBegin < m_iEndCommand && !m_bBreak.load( std::memory_order_acquire ) )
+		FinishSkippedCommands( iFinishedBegin, m_iEndCommand );
 }
 
 //
@@ -1069,11 +1558,11 @@ public:
 	}
 
 public:
-	ProcessCommandRange_Singleton( uint32_t threads, uint32_t flags ) : m_nThreads( threads )
+	ProcessCommandRange_Singleton( uint32_t threads, uint32_t packThreads, Compiler::ICompilerBackend& backend, uint32_t flags ) : m_nThreads( threads )
 	{
 		Assert( !Instance() );
 		Instance() = this;
-		Startup( flags );
+		Startup( backend, flags, packThreads );
 	}
 
 	~ProcessCommandRange_Singleton()
@@ -1087,10 +1576,9 @@ public:
 	void ProcessCommandRange( uint64_t shaderStart, uint64_t shaderEnd );
 
 	void Stop();
-	bool Stoped() const { return m_bStopped; }
 
 protected:
-	void Startup( uint32_t flags );
+	void Startup( Compiler::ICompilerBackend& backend, uint32_t flags, uint32_t packThreads );
 	void Shutdown();
 
 	using MT = CWorkerAccumState<std::mutex>;
@@ -1103,7 +1591,6 @@ protected:
 	};
 
 	const uint32_t m_nThreads;
-	bool m_bStopped = false;
 };
 
 // TODO: Cleanup this hack
@@ -1112,18 +1599,18 @@ static void StopCommandRange()
 	ProcessCommandRange_Singleton::Instance()->Stop();
 }
 
-void ProcessCommandRange_Singleton::Startup( uint32_t flags )
+void ProcessCommandRange_Singleton::Startup( Compiler::ICompilerBackend& backend, uint32_t flags, uint32_t packThreads )
 {
 	if ( m_nThreads > 1 )
 	{
 		// Make sure that our mutex is in multi-threaded mode
-		Threading::g_mtxGlobal.EnableThreadedMode();
-		Threading::g_mtxMsgReport.EnableThreadedMode();
+		Threading::g_mtxConsole.EnableThreadedMode();
 
-		m_MT = new MT( flags );
+		// Packaging threads come on top of the compiling ones, by default a quarter of them
+		m_MT = new MT( backend, flags, packThreads ? packThreads : std::max( m_nThreads / 4, 1U ) );
 	}
-	else // Otherwise initialize single-threaded mode
-		m_ST = new ST( flags );
+	else // Otherwise initialize single-threaded mode, packaging in place
+		m_ST = new ST( backend, flags, 0 );
 }
 
 void ProcessCommandRange_Singleton::Shutdown()
@@ -1136,7 +1623,6 @@ void ProcessCommandRange_Singleton::Shutdown()
 
 void ProcessCommandRange_Singleton::Stop()
 {
-	m_bStopped = true;
 	if ( m_nThreads > 1 )
 		m_MT->Stop();
 	else
@@ -1165,7 +1651,7 @@ static void Shader_ParseShaderInfoFromCompileCommands( const CfgProcessor::CfgEn
 	{
 		CfgProcessor::CfgEntryInfo const* info = Combo_GetEntryInfo( hCombo );
 
-		memset( &shaderInfo, 0, sizeof( ShaderInfo_t ) );
+		shaderInfo = {};
 
 		shaderInfo.m_CentroidMask       = info->m_nCentroidMask;
 		shaderInfo.m_nShaderCombo       = 0;
@@ -1181,16 +1667,7 @@ static void Shader_ParseShaderInfoFromCompileCommands( const CfgProcessor::CfgEn
 	}
 }
 
-struct ShaderInputData
-{
-	std::string name;
-	std::string_view version;
-	std::string_view target;
-
-	bool operator==(const ShaderInputData&) const = default;
-	std::strong_ordering operator<=>(const ShaderInputData&) const = default;
-};
-static std::unique_ptr<CfgProcessor::CfgEntryInfo[]> Shared_ParseListOfCompileCommands( std::set<ShaderInputData> files, bool bForce, bool bSpewSkips, bool isCSGO )
+std::unique_ptr<CfgProcessor::CfgEntryInfo[]> Shared_ParseListOfCompileCommands( std::set<ShaderInputData> files, bool bForce, bool bSpewSkips, bool isCSGO )
 {
 	using namespace std::literals;
 	const Clock::time_point tt_start = Clock::now();
@@ -1212,6 +1689,12 @@ static std::unique_ptr<CfgProcessor::CfgEntryInfo[]> Shared_ParseListOfCompileCo
 			failed = true;
 			continue;
 		}
+		if ( conf.static_c.size() + conf.dynamic_c.size() > CfgProcessor::MaxComboDefines )
+		{
+			std::cout << clr::red << file.name << " has more than "sv << CfgProcessor::MaxComboDefines << " combos"sv << clr::reset << std::endl;
+			failed = true;
+			continue;
+		}
 		Parser::WriteInclude( g_pShaderPath / "include"sv / ( name + ".inc" ), name, file.target, conf.static_c, conf.dynamic_c, conf.skip, isCSGO );
 		conf.name = std::move( name );
 		conf.crc32 = crc;
@@ -1230,119 +1713,55 @@ static std::unique_ptr<CfgProcessor::CfgEntryInfo[]> Shared_ParseListOfCompileCo
 
 	auto arrEntries = CfgProcessor::DescribeConfiguration( bSpewSkips );
 
+	// Skipped combos are never compiled, leave them out
 	uint64_t numCompileCommands = 0, numStaticCombos = 0;
+	bool bExact = true;
 	for ( const CfgProcessor::CfgEntryInfo* pInfo = arrEntries.get(); pInfo && !pInfo->m_szName.empty(); ++pInfo )
 	{
-		numStaticCombos += pInfo->m_numStaticCombos;
-		numCompileCommands = pInfo->m_iCommandEnd;
+		numStaticCombos += pInfo->m_numNonSkippedStaticCombos;
+		numCompileCommands += pInfo->m_numNonSkippedCombos;
+		bExact = bExact && pInfo->m_bNonSkippedExact;
 	}
 
 	const Clock::time_point tt_end = Clock::now();
 
-	std::cout << "\rCompiling "sv << clr::green << PrettyPrint( numCompileCommands ) << clr::reset << " commands  in "sv << clr::green << PrettyPrint( numStaticCombos ) << clr::reset << " static combos, setup took "sv << clr::green << duration_cast<chrono::seconds>( tt_end - tt_start ).count() << clr::reset << " seconds."sv << endLine;
+	std::cout << ( bExact ? "\rCompiling "sv : "\rCompiling up to "sv ) << clr::green << PrettyPrint( numCompileCommands ) << clr::reset << " commands  in "sv << clr::green << PrettyPrint( numStaticCombos ) << clr::reset << " static combos, setup took "sv << clr::green << duration_cast<chrono::seconds>( tt_end - tt_start ).count() << clr::reset << " seconds."sv << endLine;
 
 	return arrEntries;
 }
 
-static void CompileShaders( std::unique_ptr<CfgProcessor::CfgEntryInfo[]> arrEntries, uint32_t threads, uint32_t flags )
+void CompileShaders( std::unique_ptr<CfgProcessor::CfgEntryInfo[]> arrEntries, uint32_t threads, uint32_t packThreads, Compiler::ICompilerBackend& backend, uint32_t flags )
 {
-	ProcessCommandRange_Singleton pcr{ threads, flags };
+	ProcessCommandRange_Singleton pcr{ threads, packThreads, backend, flags };
 
 	//
-	// We will iterate on the cfg entries and process them
+	// Stick the shader info for all the cfg entries up front,
+	// the workers write each shader out as soon as it is finished
 	//
-	for ( const CfgProcessor::CfgEntryInfo* pEntry = arrEntries.get(); pEntry && !pEntry->m_szName.empty(); ++pEntry )
+	CfgProcessor::CfgEntryInfo* pEntry = arrEntries.get();
+	for ( ; pEntry && !pEntry->m_szName.empty(); ++pEntry )
 	{
-		//
-		// Stick the shader info
-		//
-		ShaderInfo_t siLastShaderInfo;
-		memset( &siLastShaderInfo, 0, sizeof( siLastShaderInfo ) );
-
-		Shader_ParseShaderInfoFromCompileCommands( pEntry, siLastShaderInfo );
-
-		g_ShaderToShaderInfo[pEntry->m_szName] = siLastShaderInfo;
-
-		//
-		// Compile stuff
-		//
-		pcr.ProcessCommandRange( pEntry->m_iCommandStart, pEntry->m_iCommandEnd );
-
-		if ( pcr.Stoped() )
-			break;
-
-		//
-		// Now when the whole shader is finished we can write it
-		//
-		WriteShaderFiles( pEntry->m_szName );
-	}
-
-	std::cout << "\r"sv << clr::escaped( lineRewind ) << endLine;
-}
-
-static LONG WINAPI ExceptionFilter( _EXCEPTION_POINTERS* pExceptionInfo )
-{
-	constexpr const auto iType = static_cast<MINIDUMP_TYPE>( MiniDumpNormal | MiniDumpWithDataSegs | MiniDumpWithIndirectlyReferencedMemory | MiniDumpWithThreadInfo );
-
-	// create a unique filename for the minidump based on the current time and module name
-	time_t currTime = time( nullptr );
-	struct tm pTime;
-	localtime_s( &pTime, &currTime );
-
-	// strip off the rest of the path from the .exe name
-	char rgchModuleName[MAX_PATH];
-	::GetModuleFileName( nullptr, rgchModuleName, std::size( rgchModuleName ) );
-	char* pch1 = strchr( rgchModuleName, '.' );
-	if ( pch1 )
-		*pch1 = 0;
-	const char* pch = strchr( rgchModuleName, '\\' );
-	if ( pch )
-		// move past the last slash
-		pch++;
-	else
-		pch = "unknown";
+		auto& pContext = g_arrShaderContexts.emplace_back( std::make_unique<ShaderCompileContext>() );
 
-	// can't use the normal string functions since we're in tier0
-	char rgchFileName[MAX_PATH];
-	_snprintf_s( rgchFileName, std::size( rgchFileName ),
-		"%s_%d%.2d%2d%.2d%.2d%.2d.mdmp",
-		pch,
-		pTime.tm_year + 1900,	/* Year less 2000 */
-		pTime.tm_mon + 1,		/* month (0 - 11 : 0 = January) */
-		pTime.tm_mday,			/* day of month (1 - 31) */
-		pTime.tm_hour,			/* hour (0 - 23) */
-		pTime.tm_min,			/* minutes (0 - 59) */
-		pTime.tm_sec			/* seconds (0 - 59) */
-		);
+		Shader_ParseShaderInfoFromCompileCommands( pEntry, pContext->m_ShaderInfo );
 
-	BOOL bMinidumpResult = FALSE;
-	const HANDLE hFile = ::CreateFile( rgchFileName, GENERIC_WRITE, FILE_SHARE_WRITE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr );
+		pContext->m_nCommandsLeft = pEntry->m_numCombos;
+		g_nPendingCombos += pEntry->m_numNonSkippedCombos;
+		g_bPendingCombosExact = g_bPendingCombosExact && pEntry->m_bNonSkippedExact;
 
-	if ( hFile )
-	{
-		// dump the exception information into the file
-		MINIDUMP_EXCEPTION_INFORMATION ExInfo;
-		ExInfo.ThreadId = GetCurrentThreadId();
-		ExInfo.ExceptionPointers = pExceptionInfo;
-		ExInfo.ClientPointers = FALSE;
-
-		bMinidumpResult = MiniDumpWriteDump( ::GetCurrentProcess(), ::GetCurrentProcessId(), hFile, iType, &ExInfo, nullptr, nullptr );
-		CloseHandle( hFile );
+		CfgProcessor::SetEntryContext( *pEntry, pContext.get() );
 	}
 
-	// mark any failed minidump writes by renaming them
-	if ( !bMinidumpResult )
-	{
-		char rgchFailedFileName[_MAX_PATH];
-		_snprintf_s( rgchFailedFileName, std::size( rgchFailedFileName ), "failed_%s", rgchFileName );
-		std::error_code c;
-		fs::rename( rgchFileName, rgchFailedFileName, c );
-	}
+	//
+	// Compile stuff, pEntry is the terminator entry now
+	//
+	if ( pEntry && pEntry != arrEntries.get() )
+		pcr.ProcessCommandRange( arrEntries[0].m_iCommandStart, pEntry->m_iCommandStart );
 
-	return EXCEPTION_CONTINUE_SEARCH;
+	std::cout << "\r"sv << clr::escaped( lineRewind ) << endLine;
 }
 
-static void PrintCompileErrors( bool skipWarnings )
+void PrintCompileErrors( bool skipWarnings )
 {
 	// Write all the errors
 	//////////////////////////////////////////////////////////////////////////
@@ -1351,14 +1770,15 @@ static void PrintCompileErrors( bool skipWarnings )
 	//
 	//////////////////////////////////////////////////////////////////////////
 
-	if ( !g_CompilerMsg.empty() )
+	size_t totalWarnings = 0, totalErrors = 0;
+	for ( const auto& pContext : g_arrShaderContexts )
+	{
+		totalWarnings += pContext->m_Msg.warning.size();
+		totalErrors += pContext->m_Msg.error.size();
+	}
+
+	if ( totalWarnings || totalErrors )
 	{
-		size_t totalWarnings = 0, totalErrors = 0;
-		for ( const auto& msg : g_CompilerMsg )
-		{
-			totalWarnings += msg.second.warning.size();
-			totalErrors += msg.second.error.size();
-		}
 		std::cerr << clr::escaped( "\033[2K"sv ) << clr::yellow << "WARNINGS"sv << clr::reset << "/"sv << clr::red << "ERRORS "sv << clr::reset << totalWarnings << "/"sv << totalErrors << '\n';
 
 		const auto& trim = []( std::string s ) -> std::string
@@ -1369,11 +1789,11 @@ static void PrintCompileErrors( bool skipWarnings )
 
 		const size_t cwdLen = fs::current_path().string().length() + 1;
 
-		for ( const auto& sMsg : g_CompilerMsg )
+		for ( const auto& pContext : g_arrShaderContexts )
 		{
-			const auto& msg             = sMsg.second;
-			const auto& shaderName      = sMsg.first;
-			const std::string searchPat = std::string( g_ShaderToShaderInfo[shaderName].m_pShaderSrc ) + "(";
+			const auto& msg             = pContext->m_Msg;
+			const auto& shaderName      = pContext->m_ShaderInfo.m_pShaderName;
+			const std::string searchPat = std::string( pContext->m_ShaderInfo.m_pShaderSrc ) + "(";
 
 			if ( !skipWarnings )
 			{
@@ -1415,366 +1835,29 @@ static void PrintCompileErrors( bool skipWarnings )
 	}
 
 	// Failed shaders summary
-	for ( const auto& failed : g_ShaderHadError )
-		std::cerr << clr::escaped( "\033[2K"sv ) << clr::pinkish << "FAILED: "sv << clr::red << failed << clr::reset << '\n';
-}
-
-static bool s_write = true;
-static BOOL WINAPI CtrlHandler( DWORD signal )
-{
-	if ( signal == CTRL_C_EVENT )
+	for ( const auto& pContext : g_arrShaderContexts )
 	{
-		s_write = false;
-		if ( auto inst = ProcessCommandRange_Singleton::Instance() )
-			inst->Stop();
-		PrintCompileErrors( false );
-		SetThreadExecutionState( ES_CONTINUOUS );
+		if ( pContext->m_bHadError )
+			std::cerr << clr::escaped( "\033[2K"sv ) << clr::pinkish << "FAILED: "sv << clr::red << pContext->m_ShaderInfo.m_pShaderName << clr::reset << '\n';
 	}
-
-	return FALSE;
 }
 
-static void WriteStats( bool skipWarnings )
+void StopCompileShaders()
 {
-	if ( s_write )
-		PrintCompileErrors( skipWarnings );
-
-	//
-	// End
-	//
-	const Clock::time_point end = Clock::now();
-
-	std::cout << "\r"sv << clr::green << FormatTime( duration_cast<chrono::seconds>( end - g_flStartTime ).count() ) << clr::reset << " elapsed"sv << std::endl;
+	if ( auto inst = ProcessCommandRange_Singleton::Instance() )
+		inst->Stop();
 }
 
-static constexpr const char* const validTypes[] =
-{
-	"vs", "ps", "gs", "ds", "hs"
-};
-
-static constexpr const char* const validModels[] =
+std::vector<std::string_view> GetCompiledShaderNames()
 {
-#if defined(SC_BUILD_PS1_X_COMPILER)
-    "11",
-    "12",
-    "13",
-    "14",
-#endif  // SC_BUILD_PS1_X_COMPILER
-	"20b", "30", "40", "41", "50", "51"
-};
-
-void OnNewOrMallocFailure() noexcept
-{
-	std::cerr << clr::red << clr::bold
-			  << "ERROR: Failed to allocate memory. Please close other processes and retry."
-			  << clr::reset
-			  << std::endl;
-	exit( ENOMEM );
+	std::vector<std::string_view> names;
+	names.reserve( g_arrShaderContexts.size() );
+	for ( const auto& pContext : g_arrShaderContexts )
+		names.emplace_back( pContext->m_ShaderInfo.m_pShaderName );
+	return names;
 }
 
-int main( int argc, const char* argv[] )
+size_t GetNumFailedShaders()
 {
-	const ScopedNewHandler scopedNewHandler{ OnNewOrMallocFailure };
-
-	{
-		const HANDLE console = GetStdHandle( STD_OUTPUT_HANDLE );
-		DWORD mode;
-		GetConsoleMode( console, &mode );
-		if ( SetConsoleMode( console, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING ) )
-			std::cout << clr::colorize;
-		else
-			std::cout << clr::nocolorize;
-		SetConsoleCtrlHandler( CtrlHandler, true );
-	}
-
-	bool parseLegacy = false;
-	for ( int i = 1; i < argc; i++ )
-	{
-		if ( !_stricmp (argv[i], "-nompi"  ) || !_stricmp(argv[i], "-nop4" ) )
-		{
-			parseLegacy = true;
-			break;
-		}
-	}
-
-	ez::ezOptionParser cmdLine{};
-	cmdLine.overview = "Source shader compiler.";
-	cmdLine.syntax   = "ShaderCompile [OPTIONS] file1.fxc [file2.fxc...]";
-	if ( parseLegacy )
-	{
-		cmdLine.add( "", true, 1, 0, "", "-game" );
-		cmdLine.add( "", true, 1, 0, "", "-shaderpath" );
-		cmdLine.add( "0", false, 1, 0, "", "-threads" );
-		cmdLine.add( "", false, 0, 0, "", "-nompi" );
-		cmdLine.add( "", false, 0, 0, "", "-nop4" );
-		cmdLine.add( "", false, 0, 0, "", "-allowdebug" );
-		cmdLine.add( "", false, 0, 0, "", "-types" );
-		cmdLine.add( "", false, 0, 0, "", "-ver" );
-	}
-	else
-	{
-		cmdLine.add( "", true, -1, ',', "Sets shader version", "-ver", "/ver", new ez::ezOptionValidator{ ez::ezOptionValidator::T, ez::ezOptionValidator::IN, validModels, std::size( validModels ), false } );
-		cmdLine.add( "", true, 1, 0, "Base path for shaders", "-shaderpath", "/shaderpath" );
-		cmdLine.add( "", false, 0, 0, "Skip crc check during compilation", "-force", "/force" );
-		cmdLine.add( "", false, 0, 0, "Calculate crc for shader", "-crc", "/crc" );
-		cmdLine.add( "", false, 0, 0, "Generate only header", "-dynamic", "/dynamic" );
-		cmdLine.add( "", false, 0, 0, "Stop on first error", "-fastfail", "/fastfail" );
-		cmdLine.add( "0", false, 1, 0, "Number of threads used, defaults to core count", "-threads", "/threads" );
-		cmdLine.add( "", false, 0, 0, "Shows help", "-help", "-h", "/help", "/h" );
-
-		cmdLine.add( "", false, 0, 0, "Verbose file cache and final shader info", "-verbose", "/verbose" );
-		cmdLine.add( "", false, 0, 0, "Verbose compile commands", "-verbose2", "/verbose2" );
-		cmdLine.add( "", false, 0, 0, "Enables preprocessor debug printing", "-verbose_preprocessor" );
-
-		cmdLine.add( "", false, 0, 0, "Skips shader validation", "/Vd", "-no-validation" );
-		cmdLine.add( "", false, 0, 0, "Directs the compiler to not use flow-control constructs where possible", "/Gfa", "-no-flow-control" );
-		cmdLine.add( "", false, 0, 0, "Directs the compiler to use flow-control constructs where possible", "/Gfp", "-prefer-flow-control" );
-		cmdLine.add( "", false, 0, 0, "Disables shader optimization", "/Od", "-disable-optimization" );
-		cmdLine.add( "", false, 0, 0, "Enable debugging information", "/Zi", "-debug-info" );
-		cmdLine.add( "1", false, 1, 0, "Set optimization level (0-3)", "/O", "-optimize" );
-		cmdLine.add( "", false, -1, ',', "Set shader type, if compiling multiple different shaders, values can be separated by ','", "/T", "-types", new ez::ezOptionValidator{ ez::ezOptionValidator::T, ez::ezOptionValidator::IN, validTypes, std::size( validTypes ), false } );
-		cmdLine.add( "", false, 0, 0, "Generate ShaderComboSemantics_t and friends for shader", "-csgo", "/csgo" );
-	}
-
-	cmdLine.parse( argc, argv );
-
-	if ( cmdLine.isSet( "-help" ) )
-	{
-		CONSOLE_SCREEN_BUFFER_INFO csbi;
-		GetConsoleScreenBufferInfo( GetStdHandle( STD_OUTPUT_HANDLE ), &csbi );
-		std::string usage;
-		cmdLine.getUsageDescriptions( usage, csbi.srWindow.Right - csbi.srWindow.Left + 1, ez::ezOptionParser::ALIGN );
-		std::cout << cmdLine.overview << "\n\n"
-				  << "Usage: "sv << cmdLine.syntax << "\n\n"sv
-				  << clr::green << clr::bold << "OPTIONS:\n"sv
-				  << clr::reset << usage << std::endl;
-		return 0;
-	}
-
-	g_flStartTime = Clock::now();
-
-	uint32_t flags = 0;
-	if ( cmdLine.isSet( "/Vd" ) )
-		flags |= D3DCOMPILE_SKIP_VALIDATION;
-
-	// Flow control
-	if ( cmdLine.isSet( "/Gfa" ) )
-		flags |= D3DCOMPILE_AVOID_FLOW_CONTROL;
-	else if ( cmdLine.isSet( "/Gfp" ) )
-		flags |= D3DCOMPILE_PREFER_FLOW_CONTROL;
-
-	if ( cmdLine.isSet( "/Zi" ) )
-		flags |= D3DCOMPILE_DEBUG | D3DCOMPILE_DEBUG_NAME_FOR_SOURCE;
-
-	int optLevel = 1;
-	if ( !parseLegacy )
-		cmdLine.get( "/O" )->getInt( optLevel );
-	switch ( optLevel )
-	{
-	case 0:
-		flags |= D3DCOMPILE_OPTIMIZATION_LEVEL0;
-		break;
-	default:
-		std::cout << "Unknown optimization level "sv << optLevel << ", using default!"sv << std::endl;
-		break;
-	case 1:
-		flags |= D3DCOMPILE_OPTIMIZATION_LEVEL1;
-		break;
-	case 2:
-		flags |= D3DCOMPILE_OPTIMIZATION_LEVEL2;
-		break;
-	case 3:
-		flags |= D3DCOMPILE_OPTIMIZATION_LEVEL3;
-		break;
-	}
-
-	if ( std::vector<std::string> badOptions; !cmdLine.gotRequired( badOptions ) || ( !parseLegacy && cmdLine.lastArgs.size() < 1 ) )
-	{
-		std::cout << clr::red << clr::bold << "ERROR: Missing argument"sv << ( badOptions.size() == 1 ? ": "sv : "s:\n"sv ) << clr::reset;
-		for ( const auto& option : badOptions )
-			std::cout << option << std::endl;
-		std::cout << clr::reset << std::endl;
-		return -1;
-	}
-
-	if ( std::vector<std::string> badOptions; !cmdLine.gotExpected( badOptions ) )
-	{
-		std::cout << clr::red << clr::bold << "ERROR: Got unexpected number of arguments for option"sv << ( badOptions.size() == 1 ? ": "sv : "s:\n"sv ) << clr::reset;
-		for ( const auto& option : badOptions )
-			std::cout << option << std::endl;
-		std::cout << clr::reset << std::endl;
-		return -1;
-	}
-
-	if ( std::vector<std::string> badOptions, badArgs; !cmdLine.gotValid( badOptions, badArgs ) )
-	{
-		for (size_t i = 0; i < badOptions.size(); ++i )
-		std::cout << clr::red << clr::bold << "ERROR: Got invalid argument \""sv << badArgs[i] << "\" for option "sv << badOptions[i] << clr::reset << std::endl;
-		std::cout << clr::reset << std::endl;
-		return -1;
-	}
-
-	auto targets = cmdLine.get( "-types" );
-	auto versions = cmdLine.get( "-ver" );
-	if ( parseLegacy )
-		/*skip*/;
-	else if ( auto s = versions->args[0]->size(); s != 1 && s != cmdLine.lastArgs.size() )
-	{
-		std::cout << clr::red << clr::bold << "ERROR: Argument count for -ver doesn't match input shader count"sv << clr::reset;
-		return -1;
-	}
-
-	if ( auto s = targets->args.empty() ? 0 : targets->args[0]->size(); s > 1 && s != cmdLine.lastArgs.size() )
-	{
-		std::cout << clr::red << clr::bold << "ERROR: Argument count for -types doesn't match input shader count"sv << clr::reset;
-		return -1;
-	}
-
-	std::string path;
-	cmdLine.get( "-shaderpath" )->getString( path );
-	g_pShaderPath = fs::absolute( std::move( path ) );
-
-	if ( parseLegacy )
-	{
-		auto fileList = g_pShaderPath / "filelist.txt"sv;
-		if ( !fs::exists( fileList ) )
-		{
-			std::cout << clr::red << "Couldn't find filelist.txt in \""sv << g_pShaderPath << "\"!"sv << clr::reset << std::endl;
-			return -1;
-		}
-
-		struct hasher : std::hash<std::string_view>
-		{
-			using is_transparent = int;
-		};
-		struct equaler : std::equal_to<std::string_view>
-		{
-			using is_transparent = int;
-		};
-
-		std::unordered_multimap<std::string, std::string, hasher, equaler> files;
-
-		{
-			std::ifstream list( fileList );
-			std::string line, line2;
-			while ( std::getline( list, line ) )
-			{
-				if ( !line.starts_with( "#BEGIN "sv ) )
-					continue;
-				std::getline( list, line2 );
-				bool is30 = line.ends_with( "30"sv );
-				files.emplace( std::move( line2 ), line.substr( line.length() - ( is30 ? 2 : 3 ), is30 ? 2 : 3 ) );
-			}
-		}
-
-		robin_hood::unordered_set<std::string_view> unique;
-		for ( auto&& f : files )
-			unique.emplace( f.first );
-
-		// fake arguments
-		versions->args.emplace_back( new std::vector<std::string*> );
-		for ( auto&& f : unique )
-		{
-			robin_hood::unordered_set<std::string_view> added;
-			auto it = files.equal_range( f );
-			for ( auto s = it.first; s != it.second; ++s )
-			{
-				if ( !added.emplace( s->second ).second )
-					continue;
-				cmdLine.lastArgs.emplace_back( new std::string( s->first ) );
-				versions->args[0]->emplace_back( new std::string( s->second ) );
-			}
-		}
-
-		if ( cmdLine.lastArgs.empty() )
-		{
-			std::cout << clr::red << "filelist.txt doesn't contain any shaders!"sv << clr::reset << std::endl;
-			return -1;
-		}
-	}
-
-	std::set<ShaderInputData> files;
-	const bool noTargets = targets->args.empty() || targets->args[0]->empty();
-	for ( size_t i = 0, c = cmdLine.lastArgs.size(); i < c; ++i )
-	{
-		std::string_view version = versions->args[0]->size() == 1 ? *versions->args[0]->at( 0 ) : *versions->args[0]->at( i );
-		std::string_view target;
-		if ( noTargets )
-			target = Parser::GetTarget( *cmdLine.lastArgs[i] );
-		else
-			target = targets->args[0]->size() == 1 ? *targets->args[0]->at( 0 ) : *targets->args[0]->at( i );
-		if ( version == "20b"sv && target == "vs"sv )
-			version = "20"sv;
-		files.insert( ShaderInputData{ fs::path( *cmdLine.lastArgs[i] ).filename().string(), version, target } );
-	}
-
-	if ( cmdLine.isSet( "-crc" ) )
-	{
-		const auto root = g_pShaderPath.string();
-		for ( const auto& file : files )
-		{
-			const std::string name = Parser::ConstructName( file.name, file.target, file.version );
-			uint32_t crc = 0;
-			Parser::CheckCrc( g_pShaderPath / file.name, root, name, crc );
-			std::cout << crc << std::endl;
-		}
-		return 0;
-	}
-
-	const bool isCSGO = cmdLine.isSet( "-csgo" );
-	if ( cmdLine.isSet( "-dynamic" ) )
-	{
-		bool failed = false;
-		const auto root = g_pShaderPath.string();
-		for ( const auto& file : files )
-		{
-			CfgProcessor::ShaderConfig conf;
-			if ( !Parser::ParseFile( g_pShaderPath / file.name, root, file.target, file.version, conf ) )
-			{
-				std::cout << clr::red << "Failed to parse "sv << file.name << clr::reset << std::endl;
-				failed = true;
-			}
-			const std::string name = Parser::ConstructName( file.name, file.target, file.version );
-			Parser::WriteInclude( g_pShaderPath / "include"sv / ( name + ".inc" ), name, file.target, conf.static_c, conf.dynamic_c, conf.skip, isCSGO );
-		}
-		return failed ? -1 : 0;
-	}
-
-	g_bVerbose = cmdLine.isSet( "-verbose" );
-	g_bVerbose2 = cmdLine.isSet( "-verbose2" );
-	g_bFastFail = cmdLine.isSet( "-fastfail" );
-
-	// Setting up the minidump handlers
-	SetUnhandledExceptionFilter( ExceptionFilter );
-	SetThreadExecutionState( ES_CONTINUOUS | ES_SYSTEM_REQUIRED );
-
-	auto entries = Shared_ParseListOfCompileCommands( std::move( files ), cmdLine.isSet( "-force" ), cmdLine.isSet( "-verbose_preprocessor" ), isCSGO );
-
-	unsigned long threads = 0;
-	cmdLine.get( "-threads" )->getULong( threads );
-	CompileShaders( std::move( entries ), threads ? threads : std::thread::hardware_concurrency(), flags );
-
-	WriteStats( parseLegacy );
-
-	if ( parseLegacy )
-	{
-		cmdLine.get( "-game" )->getString( path );
-		fs::path src = g_pShaderPath / "shaders"sv / "fxc"sv;
-		fs::path game = fs::absolute( std::move( path ) ) / "shaders"sv / "fxc"sv;
-		std::error_code c;
-		fs::create_directories( game, c );
-
-		for ( auto&& s : g_ShaderToShaderInfo )
-		{
-			fs::path f = fs::path( s.second.m_pShaderName ).replace_extension( ".vcs" );
-			c.clear();
-			fs::copy_file( src / f, game / f, c );
-			if ( c )
-				std::cout << clr::red << "Coudn't copy "sv << f << " to game shader directory!"sv << clr::reset << std::endl;
-		}
-	}
-
-	SetThreadExecutionState( ES_CONTINUOUS );
-
-	return gsl::narrow_cast<int>( g_ShaderHadError.size() );
-}
\ No newline at end of file
+	return std::count_if( g_arrShaderContexts.begin(), g_arrShaderContexts.end(), []( const auto& pContext ) { return pContext->m_bHadError.load(); } );
+}
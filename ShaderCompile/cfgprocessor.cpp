@@ -14,15 +14,15 @@
 #define NOMINMAX
 
 #include "cfgprocessor.h"
-#include "d3dxfxc.h"
+#include "filecache.h"
 
 #include "utlbuffer.h"
 #include <algorithm>
+#include <bit>
 #include <charconv>
 #include <cstdarg>
 #include <ctime>
 #include <filesystem>
-#include <map>
 #include <numeric>
 #include <set>
 #include <string>
@@ -33,13 +33,21 @@
 #include <inttypes.h>
 
 #include "gsl/narrow"
+#if defined( __AVX2__ )
+#include <immintrin.h>
+#elif defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define SC_SKIP_LANES_SSE2
+#include <emmintrin.h>
+#endif
 #include "termcolor/style.hpp"
 #include "termcolors.hpp"
 #include "strmanip.hpp"
 #include "shaderparser.h"
 
+#ifdef _MSC_VER
 // Type conversions should be controlled by programmer explicitly - shadercompile makes use of 64-bit integer arithmetics
 #pragma warning( error : 4244 )
+#endif
 
 namespace clr
 {
@@ -58,6 +66,10 @@ public:
 	explicit Define( const std::string& szName, int min, int max, bool bStatic )
 		: m_sName( szName ), m_min( min ), m_max( max ), m_bStatic( bStatic )
 	{
+		// Text of every value up front, compile commands just point at it
+		m_arrValues.reserve( static_cast<size_t>( static_cast<int64_t>( max ) - min + 1 ) );
+		for ( int64_t value = min; value <= max; ++value )
+			m_arrValues.emplace_back( std::to_string( value ) );
 	}
 
 public:
@@ -65,11 +77,13 @@ public:
 	[[nodiscard]] int Min() const noexcept { return m_min; }
 	[[nodiscard]] int Max() const noexcept { return m_max; }
 	[[nodiscard]] bool IsStatic() const noexcept { return m_bStatic; }
+	[[nodiscard]] const std::string& ValueText( int value ) const noexcept { return m_arrValues[static_cast<size_t>( static_cast<int64_t>( value ) - m_min )]; }
 
 protected:
 	std::string m_sName;
 	int m_min, m_max;
 	bool m_bStatic;
+	std::vector<std::string> m_arrValues;
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -87,6 +101,28 @@ public:
 	virtual int GetVariableSlot( const std::string& szVariableName ) const noexcept	= 0;
 };
 
+// Instruction of a flattened expression, operands are taken from the evaluation stack
+struct ExprOp
+{
+	enum Code : int32_t
+	{
+		Constant,	// push m_nArg
+		Variable,	// push value of slot m_nArg
+		Negate,
+		And,
+		Or,
+		Eq,
+		Neq,
+		G,
+		Ge,
+		L,
+		Le,
+	};
+
+	Code m_code;
+	int32_t m_nArg;
+};
+
 class IExpression
 {
 public:
@@ -95,12 +131,15 @@ public:
 	virtual void Print( const IEvaluationContext* pCtx ) const										= 0;
 	virtual std::string Build( const std::string& pPrefix, const IEvaluationContext* pCtx ) const	= 0;
 	virtual bool IsValid() const																	= 0;
+	// Appends postfix instructions, returns the stack depth they need
+	virtual uint32_t Compile( std::vector<ExprOp>& program ) const									= 0;
 };
 
 #define EVAL int Evaluate( [[maybe_unused]] const IEvaluationContext* pCtx ) const noexcept override
 #define PRNT void Print( [[maybe_unused]] const IEvaluationContext* pCtx ) const override
 #define BUILD std::string Build( [[maybe_unused]] const std::string& pPrefix, [[maybe_unused]] const IEvaluationContext* pCtx ) const override
 #define CHECK bool IsValid() const override
+#define COMPILE uint32_t Compile( std::vector<ExprOp>& program ) const override
 
 class CExprConstant : public IExpression
 {
@@ -119,6 +158,11 @@ public:
 	{
 		return true;
 	}
+	COMPILE
+	{
+		program.emplace_back( ExprOp{ ExprOp::Constant, m_value } );
+		return 1;
+	}
 
 private:
 	int m_value;
@@ -147,6 +191,14 @@ public:
 	{
 		return m_nSlot >= 0;
 	}
+	COMPILE
+	{
+		if ( m_nSlot >= 0 )
+			program.emplace_back( ExprOp{ ExprOp::Variable, m_nSlot } );
+		else
+			program.emplace_back( ExprOp{ ExprOp::Constant, 0 } );
+		return 1;
+	}
 
 private:
 	int m_nSlot;
@@ -181,12 +233,18 @@ BEGIN_EXPR_UNARY( CExprUnary_Negate )
 	}
 	BUILD
 	{
-		return "!" + m_x->Build( pPrefix, pCtx );
+		return std::string( "!" ) + m_x->Build( pPrefix, pCtx );
 	}
 	CHECK
 	{
 		return m_x->IsValid();
 	}
+	COMPILE
+	{
+		const uint32_t nDepth = m_x->Compile( program );
+		program.emplace_back( ExprOp{ ExprOp::Negate, 0 } );
+		return nDepth;
+	}
 END_EXPR_UNARY()
 
 class CExprBinary : public IExpression
@@ -204,6 +262,32 @@ public:
 		return m_x->IsValid() && m_y->IsValid();
 	}
 protected:
+	// Operand needing the deeper stack goes first (swapping the operator if needed),
+	// so the long "a || ( b || ( c || ... ) )" chains of skips only need two slots.
+	uint32_t CompileBinary( std::vector<ExprOp>& program, ExprOp::Code code, ExprOp::Code swappedCode ) const
+	{
+		std::vector<ExprOp> x, y;
+		const uint32_t nDepthX = m_x->Compile( x );
+		const uint32_t nDepthY = m_y->Compile( y );
+
+		uint32_t nDepth;
+		if ( nDepthY > nDepthX )
+		{
+			program.insert( program.end(), y.cbegin(), y.cend() );
+			program.insert( program.end(), x.cbegin(), x.cend() );
+			program.emplace_back( ExprOp{ swappedCode, 0 } );
+			nDepth = std::max( nDepthY, nDepthX + 1 );
+		}
+		else
+		{
+			program.insert( program.end(), x.cbegin(), x.cend() );
+			program.insert( program.end(), y.cbegin(), y.cend() );
+			program.emplace_back( ExprOp{ code, 0 } );
+			nDepth = std::max( nDepthX, nDepthY + 1 );
+		}
+		return nDepth;
+	}
+
 	IExpression* m_x;
 	IExpression* m_y;
 };
@@ -215,6 +299,7 @@ protected:
 		using CExprBinary::CExprBinary;
 
 #define EXPR_BINARY_PRIORITY( nPriority ) int Priority() const noexcept override { return nPriority; }
+#define EXPR_BINARY_OPCODE( code, swappedCode ) COMPILE { return CompileBinary( program, ExprOp::code, ExprOp::swappedCode ); }
 #define END_EXPR_BINARY() };
 
 BEGIN_EXPR_BINARY( CExprBinary_And )
@@ -235,6 +320,7 @@ BEGIN_EXPR_BINARY( CExprBinary_And )
 		return "( " + m_x->Build( pPrefix, pCtx ) + " && " + m_y->Build( pPrefix, pCtx ) + " )";
 	}
 	EXPR_BINARY_PRIORITY( 1 );
+	EXPR_BINARY_OPCODE( And, And )
 END_EXPR_BINARY()
 
 BEGIN_EXPR_BINARY( CExprBinary_Or )
@@ -255,6 +341,7 @@ BEGIN_EXPR_BINARY( CExprBinary_Or )
 		return "( " + m_x->Build( pPrefix, pCtx ) + " || " + m_y->Build( pPrefix, pCtx ) + " )";
 	}
 	EXPR_BINARY_PRIORITY( 2 );
+	EXPR_BINARY_OPCODE( Or, Or )
 END_EXPR_BINARY()
 
 BEGIN_EXPR_BINARY( CExprBinary_Eq )
@@ -275,6 +362,7 @@ BEGIN_EXPR_BINARY( CExprBinary_Eq )
 		return "( " + m_x->Build( pPrefix, pCtx ) + " == " + m_y->Build( pPrefix, pCtx ) + " )";
 	}
 	EXPR_BINARY_PRIORITY( 0 );
+	EXPR_BINARY_OPCODE( Eq, Eq )
 END_EXPR_BINARY()
 
 BEGIN_EXPR_BINARY( CExprBinary_Neq )
@@ -295,6 +383,7 @@ BEGIN_EXPR_BINARY( CExprBinary_Neq )
 		return "( " + m_x->Build( pPrefix, pCtx ) + " != " + m_y->Build( pPrefix, pCtx ) + " )";
 	}
 	EXPR_BINARY_PRIORITY( 0 );
+	EXPR_BINARY_OPCODE( Neq, Neq )
 END_EXPR_BINARY()
 
 BEGIN_EXPR_BINARY( CExprBinary_G )
@@ -315,6 +404,7 @@ BEGIN_EXPR_BINARY( CExprBinary_G )
 		return "( " + m_x->Build( pPrefix, pCtx ) + " > " + m_y->Build( pPrefix, pCtx ) + " )";
 	}
 	EXPR_BINARY_PRIORITY( 0 );
+	EXPR_BINARY_OPCODE( G, L )
 END_EXPR_BINARY()
 
 BEGIN_EXPR_BINARY( CExprBinary_Ge )
@@ -335,6 +425,7 @@ BEGIN_EXPR_BINARY( CExprBinary_Ge )
 		return "( " + m_x->Build( pPrefix, pCtx ) + " >= " + m_y->Build( pPrefix, pCtx ) + " )";
 	}
 	EXPR_BINARY_PRIORITY( 0 );
+	EXPR_BINARY_OPCODE( Ge, Le )
 END_EXPR_BINARY()
 
 BEGIN_EXPR_BINARY( CExprBinary_L )
@@ -355,6 +446,7 @@ BEGIN_EXPR_BINARY( CExprBinary_L )
 		return "( " + m_x->Build( pPrefix, pCtx ) + " < " + m_y->Build( pPrefix, pCtx ) + " )";
 	}
 	EXPR_BINARY_PRIORITY( 0 );
+	EXPR_BINARY_OPCODE( L, G )
 END_EXPR_BINARY()
 
 BEGIN_EXPR_BINARY( CExprBinary_Le )
@@ -375,6 +467,7 @@ BEGIN_EXPR_BINARY( CExprBinary_Le )
 		return "( " + m_x->Build( pPrefix, pCtx ) + " <= " + m_y->Build( pPrefix, pCtx ) + " )";
 	}
 	EXPR_BINARY_PRIORITY( 0 );
+	EXPR_BINARY_OPCODE( Le, Ge )
 END_EXPR_BINARY()
 
 class CComplexExpression : public IExpression
@@ -389,6 +482,17 @@ public:
 	void Parse( std::string szExpression );
 	void Clear() noexcept;
 
+	// Same result as Evaluate, but runs the flattened program over the variable values directly
+	[[nodiscard]] int Execute( const int* pVarSlots ) const noexcept;
+
+	// Execute for BatchSize combos at once, pRows has a row of lane values for each of GetBatchSlots.
+	// Returns the mask of lanes the expression is true for.
+	static constexpr uint32_t BatchSize		= 16;
+	static constexpr uint32_t MaxBatchRows	= 64;
+	[[nodiscard]] uint32_t ExecuteBatch( const int ( *pRows )[BatchSize] ) const noexcept;
+	[[nodiscard]] bool CanExecuteBatch() const noexcept { return !m_arrBatchProgram.empty() && m_arrBatchSlots.size() <= MaxBatchRows; }
+	[[nodiscard]] const std::vector<int>& GetBatchSlots() const noexcept { return m_arrBatchSlots; }
+
 public:
 	EVAL { return m_pRoot ? m_pRoot->Evaluate( pCtx ? pCtx : m_pContext ) : 0; }
 	PRNT
@@ -410,6 +514,10 @@ public:
 	{
 		return m_pRoot && m_pRoot != m_pDefFalse && m_pRoot->IsValid();
 	}
+	COMPILE
+	{
+		return m_pRoot ? m_pRoot->Compile( program ) : 0;
+	}
 
 protected:
 	IExpression* ParseTopLevel( char*& szExpression );
@@ -428,6 +536,20 @@ protected:
 	IEvaluationContext* m_pContext;
 
 	IExpression* m_pDefFalse;
+
+	// Deeper operands are compiled first, so the depth is at most log2 of the operand count
+	static constexpr uint32_t MaxStackDepth = 64;
+	std::vector<ExprOp> m_arrProgram;
+
+	// Same program with variables referring to rows of the distinct slots it reads
+	std::vector<ExprOp> m_arrBatchProgram;
+	std::vector<int> m_arrBatchSlots;
+
+#ifdef _DEBUG
+	// Every so many batches one is checked lane by lane against Execute and the tree
+	static constexpr uint32_t VerifyBatchEvery = 16;
+	void VerifyBatch( const int ( *pRows )[BatchSize], uint32_t nMask ) const;
+#endif
 };
 
 #undef BEGIN_EXPR_UNARY
@@ -437,11 +559,13 @@ protected:
 #undef END_EXPR_BINARY
 
 #undef EXPR_BINARY_PRIORITY
+#undef EXPR_BINARY_OPCODE
 
 #undef EVAL
 #undef PRNT
 #undef BUILD
 #undef CHECK
+#undef COMPILE
 
 void CComplexExpression::Parse( std::string szExpression )
 {
@@ -456,8 +580,266 @@ void CComplexExpression::Parse( std::string szExpression )
 
 	if ( szParse != szExpectEnd )
 		m_pRoot = m_pDefFalse;
+
+	[[maybe_unused]] const uint32_t nStackDepth = Compile( m_arrProgram );
+	Assert( nStackDepth <= MaxStackDepth );
+
+	for ( const ExprOp& op : m_arrProgram )
+	{
+		if ( op.m_code == ExprOp::Variable && std::find( m_arrBatchSlots.cbegin(), m_arrBatchSlots.cend(), op.m_nArg ) == m_arrBatchSlots.cend() )
+			m_arrBatchSlots.emplace_back( op.m_nArg );
+	}
+	std::sort( m_arrBatchSlots.begin(), m_arrBatchSlots.end() );
+
+	m_arrBatchProgram = m_arrProgram;
+	for ( ExprOp& op : m_arrBatchProgram )
+	{
+		if ( op.m_code == ExprOp::Variable )
+			op.m_nArg = static_cast<int32_t>( std::lower_bound( m_arrBatchSlots.cbegin(), m_arrBatchSlots.cend(), op.m_nArg ) - m_arrBatchSlots.cbegin() );
+	}
+}
+
+int CComplexExpression::Execute( const int* pVarSlots ) const noexcept
+{
+	if ( m_arrProgram.empty() )
+		return 0;
+
+	int stack[MaxStackDepth];
+	int* pTop = stack; // one past the top value
+
+	for ( const ExprOp& op : m_arrProgram )
+	{
+		switch ( op.m_code )
+		{
+		case ExprOp::Constant:
+			*pTop++ = op.m_nArg;
+			break;
+		case ExprOp::Variable:
+			*pTop++ = pVarSlots[op.m_nArg];
+			break;
+		case ExprOp::Negate:
+			pTop[-1] = !pTop[-1];
+			break;
+		case ExprOp::And:
+			--pTop;
+			pTop[-1] = pTop[-1] && pTop[0];
+			break;
+		case ExprOp::Or:
+			--pTop;
+			pTop[-1] = pTop[-1] || pTop[0];
+			break;
+		case ExprOp::Eq:
+			--pTop;
+			pTop[-1] = pTop[-1] == pTop[0];
+			break;
+		case ExprOp::Neq:
+			--pTop;
+			pTop[-1] = pTop[-1] != pTop[0];
+			break;
+		case ExprOp::G:
+			--pTop;
+			pTop[-1] = pTop[-1] > pTop[0];
+			break;
+		case ExprOp::Ge:
+			--pTop;
+			pTop[-1] = pTop[-1] >= pTop[0];
+			break;
+		case ExprOp::L:
+			--pTop;
+			pTop[-1] = pTop[-1] < pTop[0];
+			break;
+		case ExprOp::Le:
+			--pTop;
+			pTop[-1] = pTop[-1] <= pTop[0];
+			break;
+		}
+	}
+
+	return pTop[-1];
+}
+
+// Lanes of the batched evaluation: AVX2 when the build targets it, SSE2 on every x64 build, plain loops elsewhere.
+// Booleans are kept as 0/1 like in Execute, so they compare the same way against other values.
+namespace SkipLanes
+{
+#if defined( __AVX2__ )
+	using Vec = __m256i;
+	static constexpr uint32_t Width = 8;
+
+	static inline Vec Load( const int* p ) noexcept { return _mm256_loadu_si256( reinterpret_cast<const __m256i*>( p ) ); }
+	static inline Vec Set( int x ) noexcept { return _mm256_set1_epi32( x ); }
+	static inline Vec CmpEq( Vec a, Vec b ) noexcept { return _mm256_cmpeq_epi32( a, b ); }
+	static inline Vec CmpGt( Vec a, Vec b ) noexcept { return _mm256_cmpgt_epi32( a, b ); }
+	static inline Vec And( Vec a, Vec b ) noexcept { return _mm256_and_si256( a, b ); }
+	static inline Vec Or( Vec a, Vec b ) noexcept { return _mm256_or_si256( a, b ); }
+	static inline Vec AndNot( Vec a, Vec b ) noexcept { return _mm256_andnot_si256( a, b ); } // ~a & b
+	static inline uint32_t MoveMask( Vec a ) noexcept { return static_cast<uint32_t>( _mm256_movemask_ps( _mm256_castsi256_ps( a ) ) ); }
+#elif defined( SC_SKIP_LANES_SSE2 )
+	using Vec = __m128i;
+	static constexpr uint32_t Width = 4;
+
+	static inline Vec Load( const int* p ) noexcept { return _mm_loadu_si128( reinterpret_cast<const __m128i*>( p ) ); }
+	static inline Vec Set( int x ) noexcept { return _mm_set1_epi32( x ); }
+	static inline Vec CmpEq( Vec a, Vec b ) noexcept { return _mm_cmpeq_epi32( a, b ); }
+	static inline Vec CmpGt( Vec a, Vec b ) noexcept { return _mm_cmpgt_epi32( a, b ); }
+	static inline Vec And( Vec a, Vec b ) noexcept { return _mm_and_si128( a, b ); }
+	static inline Vec Or( Vec a, Vec b ) noexcept { return _mm_or_si128( a, b ); }
+	static inline Vec AndNot( Vec a, Vec b ) noexcept { return _mm_andnot_si128( a, b ); } // ~a & b
+	static inline uint32_t MoveMask( Vec a ) noexcept { return static_cast<uint32_t>( _mm_movemask_ps( _mm_castsi128_ps( a ) ) ); }
+#else
+	struct Vec
+	{
+		int v[4];
+	};
+	static constexpr uint32_t Width = 4;
+
+	template <typename Fn>
+	static inline Vec Map( Vec a, Vec b, Fn&& fn ) noexcept
+	{
+		Vec r;
+		for ( uint32_t i = 0; i < Width; ++i )
+			r.v[i] = fn( a.v[i], b.v[i] );
+		return r;
+	}
+
+	static inline Vec Load( const int* p ) noexcept { Vec r; memcpy( r.v, p, sizeof( r.v ) ); return r; }
+	static inline Vec Set( int x ) noexcept { return { { x, x, x, x } }; }
+	static inline Vec CmpEq( Vec a, Vec b ) noexcept { return Map( a, b, []( int x, int y ) { return x == y ? -1 : 0; } ); }
+	static inline Vec CmpGt( Vec a, Vec b ) noexcept { return Map( a, b, []( int x, int y ) { return x > y ? -1 : 0; } ); }
+	static inline Vec And( Vec a, Vec b ) noexcept { return Map( a, b, []( int x, int y ) { return x & y; } ); }
+	static inline Vec Or( Vec a, Vec b ) noexcept { return Map( a, b, []( int x, int y ) { return x | y; } ); }
+	static inline Vec AndNot( Vec a, Vec b ) noexcept { return Map( a, b, []( int x, int y ) { return ~x & y; } ); }
+	static inline uint32_t MoveMask( Vec a ) noexcept
+	{
+		uint32_t nMask = 0;
+		for ( uint32_t i = 0; i < Width; ++i )
+			nMask |= ( a.v[i] < 0 ? 1U : 0U ) << i;
+		return nMask;
+	}
+#endif
+}; // namespace SkipLanes
+
+uint32_t CComplexExpression::ExecuteBatch( const int ( *pRows )[BatchSize] ) const noexcept
+{
+	using namespace SkipLanes;
+	static constexpr uint32_t nVecs = BatchSize / Width;
+	static_assert( BatchSize % Width == 0 && BatchSize < 32 );
+
+	if ( m_arrBatchProgram.empty() )
+		return 0;
+
+	Vec stack[MaxStackDepth][nVecs];
+	Vec( *pTop )[nVecs] = stack; // one past the top value
+
+	const Vec zero = Set( 0 );
+	const Vec one  = Set( 1 );
+
+	for ( const ExprOp& op : m_arrBatchProgram )
+	{
+		switch ( op.m_code )
+		{
+		case ExprOp::Constant:
+			for ( Vec& v : *pTop )
+				v = Set( op.m_nArg );
+			++pTop;
+			break;
+		case ExprOp::Variable:
+			for ( uint32_t i = 0; i < nVecs; ++i )
+				pTop[0][i] = Load( pRows[op.m_nArg] + i * Width );
+			++pTop;
+			break;
+		case ExprOp::Negate:
+			for ( Vec& v : pTop[-1] )
+				v = And( CmpEq( v, zero ), one );
+			break;
+		case ExprOp::And:
+			--pTop;
+			for ( uint32_t i = 0; i < nVecs; ++i )
+				pTop[-1][i] = AndNot( Or( CmpEq( pTop[-1][i], zero ), CmpEq( pTop[0][i], zero ) ), one );
+			break;
+		case ExprOp::Or:
+			--pTop;
+			for ( uint32_t i = 0; i < nVecs; ++i )
+				pTop[-1][i] = AndNot( CmpEq( Or( pTop[-1][i], pTop[0][i] ), zero ), one );
+			break;
+		case ExprOp::Eq:
+			--pTop;
+			for ( uint32_t i = 0; i < nVecs; ++i )
+				pTop[-1][i] = And( CmpEq( pTop[-1][i], pTop[0][i] ), one );
+			break;
+		case ExprOp::Neq:
+			--pTop;
+			for ( uint32_t i = 0; i < nVecs; ++i )
+				pTop[-1][i] = AndNot( CmpEq( pTop[-1][i], pTop[0][i] ), one );
+			break;
+		case ExprOp::G:
+			--pTop;
+			for ( uint32_t i = 0; i < nVecs; ++i )
+				pTop[-1][i] = And( CmpGt( pTop[-1][i], pTop[0][i] ), one );
+			break;
+		case ExprOp::Ge:
+			--pTop;
+			for ( uint32_t i = 0; i < nVecs; ++i )
+				pTop[-1][i] = AndNot( CmpGt( pTop[0][i], pTop[-1][i] ), one );
+			break;
+		case ExprOp::L:
+			--pTop;
+			for ( uint32_t i = 0; i < nVecs; ++i )
+				pTop[-1][i] = And( CmpGt( pTop[0][i], pTop[-1][i] ), one );
+			break;
+		case ExprOp::Le:
+			--pTop;
+			for ( uint32_t i = 0; i < nVecs; ++i )
+				pTop[-1][i] = AndNot( CmpGt( pTop[-1][i], pTop[0][i] ), one );
+			break;
+		}
+	}
+
+	uint32_t nMask = 0;
+	for ( uint32_t i = 0; i < nVecs; ++i )
+		nMask |= ( ~MoveMask( CmpEq( pTop[-1][i], zero ) ) & ( ( 1U << Width ) - 1 ) ) << ( i * Width );
+
+#ifdef _DEBUG
+	VerifyBatch( pRows, nMask );
+#endif
+	return nMask;
 }
 
+#ifdef _DEBUG
+void CComplexExpression::VerifyBatch( const int ( *pRows )[BatchSize], uint32_t nMask ) const
+{
+	static thread_local uint32_t s_nBatches = 0;
+	if ( s_nBatches++ % VerifyBatchEvery )
+		return;
+
+	// Values of the lane in the slots the expression reads, the others stay 0
+	class CLaneValues : public IEvaluationContext
+	{
+	public:
+		CLaneValues( const IEvaluationContext* pNames, size_t nSlots ) : m_pNames( pNames ), m_arrValues( nSlots ) {}
+
+		int GetVariableValue( int nSlot ) const noexcept override { return m_arrValues[nSlot]; }
+		const std::string& GetVariableName( int nSlot ) const noexcept override { return m_pNames->GetVariableName( nSlot ); }
+		int GetVariableSlot( const std::string& szVariableName ) const noexcept override { return m_pNames->GetVariableSlot( szVariableName ); }
+
+		const IEvaluationContext* m_pNames;
+		std::vector<int> m_arrValues;
+	};
+
+	CLaneValues values( m_pContext, m_arrBatchSlots.empty() ? 0 : m_arrBatchSlots.back() + 1 );
+	for ( uint32_t iLane = 0; iLane < BatchSize; ++iLane )
+	{
+		for ( size_t iRow = 0; iRow < m_arrBatchSlots.size(); ++iRow )
+			values.m_arrValues[m_arrBatchSlots[iRow]] = pRows[iRow][iLane];
+
+		// The tree evaluator is the reference for both flattened programs
+		const uint32_t bTree = Evaluate( &values ) ? 1 : 0;
+		Assert( ( Execute( values.m_arrValues.data() ) ? 1U : 0U ) == bTree );
+		Assert( ( ( nMask >> iLane ) & 1 ) == bTree );
+	}
+}
+#endif
+
 IExpression* CComplexExpression::ParseTopLevel( char* &szExpression )
 {
 	std::vector<CExprBinary*> exprStack;
@@ -634,6 +1016,9 @@ auto CComplexExpression::Expression( Args&&... args ) -> std::enable_if_t<std::c
 void CComplexExpression::Clear() noexcept
 {
 	m_arrAllExpressions.clear();
+	m_arrProgram.clear();
+	m_arrBatchProgram.clear();
+	m_arrBatchSlots.clear();
 	m_pRoot = nullptr;
 }
 
@@ -697,22 +1082,290 @@ uint64_t ComboGenerator::NumCombos( bool bStaticCombos ) const noexcept
 		[bStaticCombos]( const Define& d ) noexcept { return d.IsStatic() == bStaticCombos ? static_cast<uint64_t>( d.Max() ) - d.Min() + 1ULL : 1ULL; } );
 }
 
+//////////////////////////////////////////////////////////////////////////
+//
+// Counts of combos left after SKIP
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Values of every define of a combo, decoded from its number
+class CComboValues : public IEvaluationContext
+{
+public:
+	explicit CComboValues( const ComboGenerator& cg ) : m_cg( cg ), m_arrValues( cg.DefineCount() ) {}
+
+	void Decode( uint64_t iComboNumber ) noexcept
+	{
+		// Mixed radix number with the first define as the lowest digit
+		const Define* pDef = m_cg.GetDefinesBase();
+		for ( int& nValue : m_arrValues )
+		{
+			const uint64_t iInterval = static_cast<uint64_t>( pDef->Max() ) - pDef->Min() + 1;
+			nValue = pDef->Min() + static_cast<int>( iComboNumber % iInterval );
+			iComboNumber /= iInterval;
+			++pDef;
+		}
+	}
+
+	[[nodiscard]] const int* Values() const noexcept { return m_arrValues.data(); }
+
+	[[nodiscard]] int GetVariableValue( int nSlot ) const noexcept override { return m_arrValues[nSlot]; }
+	[[nodiscard]] const std::string& GetVariableName( int nSlot ) const noexcept override { return m_cg.GetVariableName( nSlot ); }
+	[[nodiscard]] int GetVariableSlot( const std::string& szVariableName ) const noexcept override { return m_cg.GetVariableSlot( szVariableName ); }
+
+private:
+	const ComboGenerator& m_cg;
+	std::vector<int> m_arrValues;
+};
+
+// SKIP only reads a few defines, so only the values of those are enumerated,
+// every other define multiplies the counts by its number of values.
+class CSkipCounts
+{
+public:
+	// Above this many values of the defines SKIP reads nothing is counted, see IsExact
+	static constexpr uint64_t MaxEnumerated = 1ULL << 24;
+
+	void Count( const ComboGenerator& cg, const CComplexExpression& expr, uint64_t nMaxEnumerated = MaxEnumerated );
+
+	// When false the counts are those without SKIP, so only upper bounds
+	[[nodiscard]] bool IsExact() const noexcept { return m_bExact; }
+
+	[[nodiscard]] uint64_t NumCombos() const noexcept { return m_nCombos; }
+	[[nodiscard]] uint64_t NumStaticCombos() const noexcept { return m_nStaticCombos; }
+	[[nodiscard]] uint64_t NumDynamicCombos( uint64_t nStaticCombo ) const noexcept;
+
+	// First combo of the run the skipped iComboNumber is in, as far as it is known to be skipped without running SKIP
+	[[nodiscard]] uint64_t SkippedRunStart( uint64_t iComboNumber ) const noexcept;
+
+private:
+	// False if there were too many values to enumerate, the counts are left without SKIP then
+	[[nodiscard]] bool Enumerate( const ComboGenerator& cg, const CComplexExpression& expr, uint64_t nMaxEnumerated );
+
+#ifdef _DEBUG
+	// Brute force check of the counts, SKIP runs on every combo of small shaders
+	// and on the dynamic combos of evenly spread static combos of large ones
+	static constexpr uint64_t MaxVerified = 1ULL << 16;
+	void Verify( const ComboGenerator& cg, const CComplexExpression& expr ) const;
+#endif
+
+	struct StaticDigit
+	{
+		uint64_t m_nInterval;
+		uint64_t m_nWeight;	// in the index of m_arrDynamicCombos, 0 if SKIP doesn't read the define
+	};
+
+	bool m_bExact				= false;
+	uint64_t m_nCombos			= 0;
+	uint64_t m_nStaticCombos	= 0;
+	uint64_t m_nDynamicCombos	= 1;	// when nothing is enumerated
+	uint64_t m_nSkipBlock		= 1;	// combos in a row which only differ by defines below the ones SKIP reads
+	std::vector<uint64_t> m_arrDynamicCombos;	// by values of the static defines SKIP reads
+	std::vector<StaticDigit> m_arrStaticDigits;	// up to the last static define SKIP reads
+};
+
+void CSkipCounts::Count( const ComboGenerator& cg, const CComplexExpression& expr, uint64_t nMaxEnumerated )
+{
+	m_bExact = Enumerate( cg, expr, nMaxEnumerated );
+
+#ifdef _DEBUG
+	Verify( cg, expr );
+
+	// Shaders are hardly ever big enough to take the fallback, check it on every one
+	if ( nMaxEnumerated )
+	{
+		CSkipCounts fallback;
+		fallback.Count( cg, expr, 0 );
+		Assert( !fallback.IsExact() );
+	}
+#endif
+}
+
+bool CSkipCounts::Enumerate( const ComboGenerator& cg, const CComplexExpression& expr, uint64_t nMaxEnumerated )
+{
+	const Define* const pDefVars = cg.GetDefinesBase();
+	const size_t nDefines		 = cg.DefineCount();
+	const std::vector<int>& arrSlots = expr.GetBatchSlots();
+
+	m_nCombos		 = cg.NumCombos();
+	m_nStaticCombos	 = cg.NumCombos( true );
+	m_nDynamicCombos = cg.NumCombos( false );
+	m_arrDynamicCombos.clear();
+	m_arrStaticDigits.clear();
+
+	m_nSkipBlock = 1;
+	for ( size_t i = 0, nFirstRead = arrSlots.empty() ? nDefines : arrSlots.front(); i < nFirstRead; ++i )
+		m_nSkipBlock *= static_cast<uint64_t>( pDefVars[i].Max() ) - pDefVars[i].Min() + 1;
+
+	// Dynamic defines come first, so the index of the enumerated values has the dynamic ones as the lower digits
+	uint64_t nFreeDynamic = 1, nFreeStatic = 1, nReadDynamic = 1, nReadStatic = 1;
+	std::vector<StaticDigit> arrStaticDigits;
+	for ( size_t i = 0; i < nDefines; ++i )
+	{
+		const Define& def = pDefVars[i];
+		const uint64_t nInterval = static_cast<uint64_t>( def.Max() ) - def.Min() + 1;
+		const bool bRead = std::binary_search( arrSlots.cbegin(), arrSlots.cend(), static_cast<int>( i ) );
+		uint64_t& nFactor = def.IsStatic() ? ( bRead ? nReadStatic : nFreeStatic ) : ( bRead ? nReadDynamic : nFreeDynamic );
+		if ( def.IsStatic() )
+			arrStaticDigits.emplace_back( StaticDigit{ nInterval, bRead ? nReadStatic : 0 } );
+		if ( bRead && nFactor > nMaxEnumerated / nInterval )
+			return false;
+		nFactor *= nInterval;
+	}
+
+	if ( !expr.CanExecuteBatch() || nReadDynamic > nMaxEnumerated / nReadStatic )
+		return false;
+
+	// Run SKIP over every value of the defines it reads, a batch at a time
+	constexpr uint32_t nBatchSize = CComplexExpression::BatchSize;
+	const uint64_t nRead = nReadDynamic * nReadStatic;
+	const size_t nRows	 = arrSlots.size();
+	std::vector<int> values( nRows );
+	for ( size_t iRow = 0; iRow < nRows; ++iRow )
+		values[iRow] = pDefVars[arrSlots[iRow]].Min();
+
+	int rows[CComplexExpression::MaxBatchRows][nBatchSize];
+	m_arrDynamicCombos.assign( nReadStatic, 0 );
+	for ( uint64_t iFirst = 0; iFirst < nRead; iFirst += nBatchSize )
+	{
+		const uint32_t nLanes = static_cast<uint32_t>( std::min<uint64_t>( nBatchSize, nRead - iFirst ) );
+		for ( uint32_t iLane = 0; iLane < nLanes; ++iLane )
+		{
+			for ( size_t iRow = 0; iRow < nRows; ++iRow )
+				rows[iRow][iLane] = values[iRow];
+
+			for ( size_t iRow = 0; iRow < nRows; ++iRow )
+			{
+				if ( ++values[iRow] <= pDefVars[arrSlots[iRow]].Max() )
+					break;
+				values[iRow] = pDefVars[arrSlots[iRow]].Min();
+			}
+		}
+
+		// Unused lanes repeat the last values
+		for ( size_t iRow = 0; iRow < nRows; ++iRow )
+			std::fill( rows[iRow] + nLanes, rows[iRow] + nBatchSize, rows[iRow][nLanes - 1] );
+
+		uint32_t nKept = ~expr.ExecuteBatch( rows ) & ( ( 1U << nLanes ) - 1 );
+		for ( ; nKept; nKept &= nKept - 1 )
+			++m_arrDynamicCombos[( iFirst + std::countr_zero( nKept ) ) / nReadDynamic];
+	}
+
+	m_nCombos		= 0;
+	m_nStaticCombos = 0;
+	for ( uint64_t& nDynamicCombos : m_arrDynamicCombos )
+	{
+		nDynamicCombos *= nFreeDynamic;
+		m_nCombos += nDynamicCombos * nFreeStatic;
+		m_nStaticCombos += nDynamicCombos ? nFreeStatic : 0;
+	}
+
+	while ( !arrStaticDigits.empty() && !arrStaticDigits.back().m_nWeight )
+		arrStaticDigits.pop_back();
+	m_arrStaticDigits = std::move( arrStaticDigits );
+	return true;
+}
+
+#ifdef _DEBUG
+void CSkipCounts::Verify( const ComboGenerator& cg, const CComplexExpression& expr ) const
+{
+	// Without SKIP the counts are those of the combo generator
+	if ( !m_bExact )
+	{
+		Assert( m_nCombos == cg.NumCombos() );
+		Assert( m_nStaticCombos == cg.NumCombos( true ) );
+		Assert( m_arrDynamicCombos.empty() );
+	}
+
+	const bool bEveryCombo = cg.NumCombos() <= MaxVerified;
+	if ( !bEveryCombo && m_nDynamicCombos > MaxVerified )
+		return;
+
+	// Combos are visited in order, the tree evaluator decides on its own which ones are skipped
+	const uint64_t nStaticCombos = cg.NumCombos( true );
+	const uint64_t nStride		 = bEveryCombo ? 1 : std::max<uint64_t>( nStaticCombos / ( MaxVerified / m_nDynamicCombos ), 1 );
+	CComboValues values( cg );
+	uint64_t nCombos = 0, nNonSkippedStatic = 0, iRunStart = 0;
+	for ( uint64_t iStatic = 0; iStatic < nStaticCombos; iStatic += nStride )
+	{
+		// The static combos passed over may end in a skipped run, it isn't known where it starts
+		if ( nStride > 1 )
+			iRunStart = 0;
+
+		uint64_t nDynamicCombos = 0;
+		for ( uint64_t iCombo = iStatic * m_nDynamicCombos, iEnd = iCombo + m_nDynamicCombos; iCombo < iEnd; ++iCombo )
+		{
+			values.Decode( iCombo );
+			if ( expr.Evaluate( &values ) )
+			{
+				// Everything from the start of the known run up to here has to be skipped
+				Assert( SkippedRunStart( iCombo ) >= iRunStart );
+				continue;
+			}
+
+			++nDynamicCombos;
+			iRunStart = iCombo + 1;
+		}
+
+		// Exact counts match, the others are upper bounds
+		Assert( m_bExact ? NumDynamicCombos( iStatic ) == nDynamicCombos : NumDynamicCombos( iStatic ) >= nDynamicCombos );
+		nCombos += nDynamicCombos;
+		nNonSkippedStatic += nDynamicCombos ? 1 : 0;
+	}
+
+	if ( !bEveryCombo )
+		return;
+
+	Assert( m_bExact ? m_nCombos == nCombos : m_nCombos >= nCombos );
+	Assert( m_bExact ? m_nStaticCombos == nNonSkippedStatic : m_nStaticCombos >= nNonSkippedStatic );
+}
+#endif
+
+uint64_t CSkipCounts::NumDynamicCombos( uint64_t nStaticCombo ) const noexcept
+{
+	if ( m_arrDynamicCombos.empty() )
+		return m_nDynamicCombos;
+
+	// Static combo number is a mixed radix number with the first static define as the lowest digit
+	uint64_t iIndex = 0;
+	for ( const StaticDigit& digit : m_arrStaticDigits )
+	{
+		iIndex += ( nStaticCombo % digit.m_nInterval ) * digit.m_nWeight;
+		nStaticCombo /= digit.m_nInterval;
+	}
+	return m_arrDynamicCombos[iIndex];
+}
+
+uint64_t CSkipCounts::SkippedRunStart( uint64_t iComboNumber ) const noexcept
+{
+	uint64_t iStart = iComboNumber - iComboNumber % m_nSkipBlock;
+
+	// Static combos with nothing left are skipped as a whole
+	const uint64_t nStaticCombo = iComboNumber / m_nDynamicCombos;
+	if ( !NumDynamicCombos( nStaticCombo ) )
+		iStart = std::min( iStart, nStaticCombo * m_nDynamicCombos );
+
+	return iStart;
+}
+
 namespace ConfigurationProcessing
 {
 class CfgEntry
 {
 public:
-	CfgEntry() noexcept : m_szName( "" ), m_szShaderSrc( "" ), m_pCg( nullptr ), m_pExpr( nullptr )
+	CfgEntry() noexcept : m_szName( "" ), m_szShaderSrc( "" ), m_pCg( nullptr ), m_pExpr( nullptr ), m_eiInfo{}
 	{
-		memset( &m_eiInfo, 0, sizeof( m_eiInfo ) );
 	}
 
-	bool operator<( const CfgEntry& x ) const noexcept { return m_pCg->NumCombos() < x.m_pCg->NumCombos(); }
+	// Entries with the most combos to compile go first
+	bool operator<( const CfgEntry& x ) const noexcept { return m_skipCounts.NumCombos() < x.m_skipCounts.NumCombos(); }
 
 	std::string_view m_szName;
 	std::string_view m_szShaderSrc;
+	std::string_view m_szShaderModelDefine;	// e.g. "SHADER_MODEL_PS_2_0"
 	std::unique_ptr<ComboGenerator> m_pCg;
 	std::unique_ptr<CComplexExpression> m_pExpr;
+	CSkipCounts m_skipCounts;
 
 	CfgProcessor::CfgEntryInfo m_eiInfo;
 };
@@ -729,12 +1382,15 @@ public:
 	const CfgEntry* m_pEntry;
 
 public:
-	ComboHandleImpl() noexcept : m_iTotalCommand( 0 ), m_iComboNumber( 0 ), m_numCombos( 0 ), m_pEntry( nullptr ) {}
+	ComboHandleImpl() noexcept : m_iTotalCommand( 0 ), m_iComboNumber( 0 ), m_numCombos( 0 ), m_pEntry( nullptr ), m_arrVarSlots{}, m_nVarSlots( 0 ) {}
 	ComboHandleImpl( const ComboHandleImpl& ) = default;
+	ComboHandleImpl& operator=( const ComboHandleImpl& ) = default;
 
 	// IEvaluationContext
 private:
-	std::vector<int> m_arrVarSlots;
+	// Values are kept inline, copying a handle never allocates
+	int m_arrVarSlots[CfgProcessor::MaxComboDefines];
+	uint32_t m_nVarSlots;
 
 public:
 	int GetVariableValue( int nSlot ) const noexcept override { return m_arrVarSlots[nSlot]; }
@@ -743,119 +1399,243 @@ public:
 
 	// External implementation
 public:
-	bool Initialize( uint64_t iTotalCommand, const CfgEntry* pEntry );
-	bool AdvanceCommands( uint64_t& riAdvanceMore ) noexcept;
+	void Initialize( uint64_t iTotalCommand, uint64_t iEntryCommandStart, const CfgEntry* pEntry );
 	bool NextNotSkipped( uint64_t iTotalCommand ) noexcept;
-	bool IsSkipped() const noexcept { return m_pEntry->m_pExpr->Evaluate( this ) != 0; }
-	CfgProcessor::ComboBuildCommand BuildCommand() const;
+	bool NextCombo( uint64_t iTotalCommand ) noexcept;
+	void DecodeVarSlots() noexcept;
+	void DecrementVarSlots() noexcept;
+	bool IsSkipped() const noexcept { return m_pEntry->m_pExpr->Execute( m_arrVarSlots ) != 0; }
+	void BuildCommand( CfgProcessor::ComboBuildCommand& command ) const;
 	void FormatCommandHumanReadable( gsl::span<char> pchBuffer ) const;
+
+private:
+	bool SeekNotSkipped( uint64_t iTotalCommand ) noexcept;
+#ifdef _DEBUG
+	// Passed combos checked against the tree at most, evenly spread over the ones passed
+	static constexpr uint64_t MaxVerifiedSkips = 256;
+	void VerifySkippedSince( uint64_t iFromCombo, uint64_t iFromCommand, bool bFound ) const noexcept;
+#endif
 };
 
-static std::map<uint64_t, ComboHandleImpl> s_mapComboCommands;
+// First command of every entry in command order, followed by the terminator
+struct CommandRange
+{
+	uint64_t m_iCommandStart;
+	const CfgEntry* m_pEntry;
+};
+static std::vector<CommandRange> s_arrCommandRanges;
+
+static const CommandRange* FindCommandRange( uint64_t iCommandNumber ) noexcept
+{
+	auto it = std::upper_bound( s_arrCommandRanges.cbegin(), s_arrCommandRanges.cend(), iCommandNumber,
+		[]( uint64_t iCommand, const CommandRange& range ) noexcept { return iCommand < range.m_iCommandStart; } );
+	if ( it == s_arrCommandRanges.cbegin() )
+		return nullptr;
 
-bool ComboHandleImpl::Initialize( uint64_t iTotalCommand, const CfgEntry* pEntry )
+	--it;
+	// The terminator only has a single command
+	if ( !it->m_pEntry->m_pCg && iCommandNumber != it->m_iCommandStart )
+		return nullptr;
+	return &*it;
+}
+
+void ComboHandleImpl::Initialize( uint64_t iTotalCommand, uint64_t iEntryCommandStart, const CfgEntry* pEntry )
 {
 	m_iTotalCommand = iTotalCommand;
 	m_pEntry        = pEntry;
-	m_numCombos     = m_pEntry->m_pCg->NumCombos();
 
-	// Defines
-	const Define* const pDefVars    = m_pEntry->m_pCg->GetDefinesBase();
-	const Define* const pDefVarsEnd = m_pEntry->m_pCg->GetDefinesEnd();
+	if ( !pEntry->m_pCg )
+	{
+		// Terminator
+		m_numCombos    = 0;
+		m_iComboNumber = 0;
+		m_nVarSlots    = 0;
+		return;
+	}
 
-	// Set all the variables to max values
-	for ( const Define* pSetDef = pDefVars; pSetDef < pDefVarsEnd; ++pSetDef )
-		m_arrVarSlots.emplace_back( pSetDef->Max() );
+	m_numCombos = pEntry->m_eiInfo.m_numCombos;
 
-	m_iComboNumber = m_numCombos - 1;
-	return true;
+	// Combo numbers count down from the last combo as the commands go up
+	m_iComboNumber = m_numCombos - 1 - ( iTotalCommand - iEntryCommandStart );
+
+	m_nVarSlots = static_cast<uint32_t>( pEntry->m_pCg->DefineCount() );
+	Assert( m_nVarSlots <= CfgProcessor::MaxComboDefines );
+	DecodeVarSlots();
 }
 
-bool ComboHandleImpl::AdvanceCommands( uint64_t& riAdvanceMore ) noexcept
+void ComboHandleImpl::DecodeVarSlots() noexcept
 {
-	if ( !riAdvanceMore )
-		return true;
-
-	// Get the pointers
-	int* const pnValues    = m_arrVarSlots.data();
-	int* const pnValuesEnd = pnValues + m_arrVarSlots.size();
-	int* pSetValues;
-
 	// Defines
-	const Define* const pDefVars = m_pEntry->m_pCg->GetDefinesBase();
-	const Define* pSetDef;
+	const Define* const pDefVars    = m_pEntry->m_pCg->GetDefinesBase();
+	const Define* const pDefVarsEnd = m_pEntry->m_pCg->GetDefinesEnd();
 
-	if ( m_iComboNumber < riAdvanceMore )
+	// Combo number is a mixed radix number with the first define as the lowest digit
+	uint64_t iDigits = m_iComboNumber;
+	int* pSetValues  = m_arrVarSlots;
+	for ( const Define* pSetDef = pDefVars; pSetDef < pDefVarsEnd; ++pSetDef, ++pSetValues )
 	{
-		riAdvanceMore -= m_iComboNumber;
-		return false;
+		const uint64_t iInterval = static_cast<uint64_t>( pSetDef->Max() ) - pSetDef->Min() + 1;
+		*pSetValues = pSetDef->Min() + static_cast<int>( iDigits % iInterval );
+		iDigits /= iInterval;
 	}
+}
 
-	// Do the advance
-	m_iTotalCommand += riAdvanceMore;
-	m_iComboNumber -= riAdvanceMore;
-	for ( pSetValues = pnValues, pSetDef = pDefVars; ( pSetValues < pnValuesEnd ) && ( riAdvanceMore > 0 ); ++pSetValues, ++pSetDef )
+void ComboHandleImpl::DecrementVarSlots() noexcept
+{
+	int* pSetValues			= m_arrVarSlots;
+	int* const pnValuesEnd	= pSetValues + m_nVarSlots;
+	const Define* pSetDef	= m_pEntry->m_pCg->GetDefinesBase();
+
+	for ( ; pSetValues < pnValuesEnd; ++pSetValues, ++pSetDef )
 	{
-		riAdvanceMore += ( static_cast<uint64_t>( pSetDef->Max() ) - *pSetValues );
-		*pSetValues = pSetDef->Max();
+		if ( --*pSetValues >= pSetDef->Min() )
+			return;
 
-		const int iInterval = ( pSetDef->Max() - pSetDef->Min() + 1 );
-		*pSetValues -= static_cast<int>( riAdvanceMore % iInterval );
-		riAdvanceMore /= iInterval;
+		*pSetValues = pSetDef->Max();
 	}
+}
+
+bool ComboHandleImpl::NextCombo( uint64_t iTotalCommand ) noexcept
+{
+	if ( m_iTotalCommand + 1 >= iTotalCommand || !m_iComboNumber )
+		return false;
 
+	--m_iComboNumber;
+	++m_iTotalCommand;
+	DecrementVarSlots();
 	return true;
 }
 
 bool ComboHandleImpl::NextNotSkipped( uint64_t iTotalCommand ) noexcept
 {
-	// Get the pointers
-	int* const pnValues    = m_arrVarSlots.data();
-	int* const pnValuesEnd = pnValues + m_arrVarSlots.size();
-	int* pSetValues;
+#ifdef _DEBUG
+	const uint64_t iFromCombo   = m_iComboNumber;
+	const uint64_t iFromCommand = m_iTotalCommand;
+	const bool bFound           = SeekNotSkipped( iTotalCommand );
+	VerifySkippedSince( iFromCombo, iFromCommand, bFound );
+	return bFound;
+#else
+	return SeekNotSkipped( iTotalCommand );
+#endif
+}
 
-	// Defines
-	const Define* const pDefVars = m_pEntry->m_pCg->GetDefinesBase();
-	const Define* pSetDef;
+#ifdef _DEBUG
+void ComboHandleImpl::VerifySkippedSince( uint64_t iFromCombo, uint64_t iFromCommand, bool bFound ) const noexcept
+{
+	// Commands and combos move in lockstep
+	Assert( iFromCombo - m_iComboNumber == m_iTotalCommand - iFromCommand );
 
-	// Go ahead and run the iterations
-next_combo_iteration:
-	if ( m_iTotalCommand + 1 >= iTotalCommand || !m_iComboNumber )
+	// The slots stepped along with the combo number must match decoding it from scratch
+	ComboHandleImpl decoded( *this );
+	decoded.DecodeVarSlots();
+	Assert( std::equal( m_arrVarSlots, m_arrVarSlots + m_nVarSlots, decoded.m_arrVarSlots ) );
+
+	const CComplexExpression* const pExpr = m_pEntry->m_pExpr.get();
+	if ( bFound )
+		Assert( !pExpr->Evaluate( this ) );
+
+	// Every combo passed over must be skipped by the tree evaluator
+	const uint64_t iPassedEnd = bFound ? m_iComboNumber + 1 : m_iComboNumber;
+	if ( iPassedEnd >= iFromCombo )
+		return;
+
+	const uint64_t nPassed = iFromCombo - iPassedEnd;
+	const uint64_t nStride = ( nPassed + MaxVerifiedSkips - 1 ) / MaxVerifiedSkips;
+	for ( uint64_t iCombo = iPassedEnd; iCombo < iFromCombo; iCombo += nStride )
+	{
+		decoded.m_iComboNumber = iCombo;
+		decoded.DecodeVarSlots();
+		Assert( pExpr->Evaluate( &decoded ) );
+	}
+}
+#endif
+
+bool ComboHandleImpl::SeekNotSkipped( uint64_t iTotalCommand ) noexcept
+{
+	// Most combos aren't skipped, the next one is checked on its own
+	if ( !NextCombo( iTotalCommand ) )
 		return false;
+	if ( !IsSkipped() )
+		return true;
 
-	--m_iComboNumber;
-	++m_iTotalCommand;
+	const CComplexExpression* const pExpr = m_pEntry->m_pExpr.get();
+	const CSkipCounts& skipCounts		  = m_pEntry->m_skipCounts;
 
-	// Do a next iteration
-	for ( pSetValues = pnValues, pSetDef = pDefVars; pSetValues < pnValuesEnd; ++pSetValues, ++pSetDef )
+	constexpr uint32_t nBatchSize = CComplexExpression::BatchSize;
+	const std::vector<int>& arrSlots = pExpr->GetBatchSlots();
+	const size_t nRows = arrSlots.size();
+	int rows[CComplexExpression::MaxBatchRows][nBatchSize];
+
+	// The current combo is skipped at the top of every iteration
+	for ( ;; )
 	{
-		if ( --*pSetValues >= pSetDef->Min() )
-			goto have_combo_iteration;
+		const uint64_t nCommandsLeft = m_iTotalCommand + 1 >= iTotalCommand ? 0 : iTotalCommand - m_iTotalCommand - 1;
 
-		*pSetValues = pSetDef->Max();
-	}
+		// Leap over the rest of the run SKIP can't tell apart
+		if ( const uint64_t iRunStart = skipCounts.SkippedRunStart( m_iComboNumber ); iRunStart < m_iComboNumber )
+		{
+			if ( const uint64_t nLeap = std::min( m_iComboNumber - iRunStart, nCommandsLeft ) )
+			{
+				m_iComboNumber -= nLeap;
+				m_iTotalCommand += nLeap;
+				DecodeVarSlots();
+			}
 
-	return false;
+			if ( !NextCombo( iTotalCommand ) )
+				return false;
+			if ( !IsSkipped() )
+				return true;
+			continue;
+		}
 
-have_combo_iteration:
-	if ( m_pEntry->m_pExpr->Evaluate( this ) )
-		goto next_combo_iteration;
+		if ( !pExpr->CanExecuteBatch() )
+		{
+			if ( !NextCombo( iTotalCommand ) )
+				return false;
+			if ( !IsSkipped() )
+				return true;
+			continue;
+		}
 
-	return true;
-}
+		// Otherwise go through the following combos a batch at a time
+		const uint32_t nLanes = static_cast<uint32_t>( std::min( { static_cast<uint64_t>( nBatchSize ), m_iComboNumber, nCommandsLeft } ) );
+		if ( !nLanes )
+			return false;
 
-static thread_local robin_hood::unordered_node_set<std::string> s_tlPool;
-template <typename T>
-static std::string_view String( const T& str )
-{
-	return *s_tlPool.emplace( str ).first;
+		for ( uint32_t iLane = 0; iLane < nLanes; ++iLane )
+		{
+			DecrementVarSlots();
+			for ( size_t iRow = 0; iRow < nRows; ++iRow )
+				rows[iRow][iLane] = m_arrVarSlots[arrSlots[iRow]];
+		}
+		m_iComboNumber -= nLanes;
+		m_iTotalCommand += nLanes;
+
+		// Unused lanes repeat the last combo
+		for ( size_t iRow = 0; iRow < nRows; ++iRow )
+			std::fill( rows[iRow] + nLanes, rows[iRow] + nBatchSize, rows[iRow][nLanes - 1] );
+
+		const uint32_t nSkipped = static_cast<uint32_t>( std::countr_one( pExpr->ExecuteBatch( rows ) ) );
+		if ( nSkipped < nLanes )
+		{
+			// Back to the first combo which isn't skipped
+			const uint32_t nRewind = nLanes - 1 - nSkipped;
+			if ( nRewind )
+			{
+				m_iComboNumber += nRewind;
+				m_iTotalCommand -= nRewind;
+				DecodeVarSlots();
+			}
+			return true;
+		}
+	}
 }
 
-CfgProcessor::ComboBuildCommand ComboHandleImpl::BuildCommand() const
+void ComboHandleImpl::BuildCommand( CfgProcessor::ComboBuildCommand& command ) const
 {
 	// Get the pointers
-	const int* const pnValues    = m_arrVarSlots.data();
-	const int* const pnValuesEnd = pnValues + m_arrVarSlots.size();
+	const int* const pnValues    = m_arrVarSlots;
+	const int* const pnValuesEnd = pnValues + m_nVarSlots;
 	const int* pSetValues;
 
 	// Defines
@@ -863,35 +1643,27 @@ CfgProcessor::ComboBuildCommand ComboHandleImpl::BuildCommand() const
 	const Define* const pDefVarsEnd = m_pEntry->m_pCg->GetDefinesEnd();
 	const Define* pSetDef;
 
-	CfgProcessor::ComboBuildCommand command{ m_pEntry->m_eiInfo.m_szEntryPoint, m_pEntry->m_szShaderSrc, m_pEntry->m_eiInfo.m_szShaderVersion };
-	command.defines.reserve( m_pEntry->m_pCg->DefineCount() + 2 );
+	command.entryPoint	= m_pEntry->m_eiInfo.m_szEntryPoint;
+	command.fileName	= m_pEntry->m_szShaderSrc;
+	command.shaderModel	= m_pEntry->m_eiInfo.m_szShaderVersion;
 
-	char tmpBuf[24]{};
-	std::to_chars( std::begin( tmpBuf ), std::end( tmpBuf ), m_iComboNumber, 16 );
+	// Reuses the storage of the previous command, so nothing is allocated once the defines fit
+	command.defines.clear();
 
-	command.defines.emplace_back( "SHADERCOMBO", String( tmpBuf ) );
-
-	char version[16];
-	strcpy_s( version, sizeof( version ), m_pEntry->m_eiInfo.m_szShaderVersion.data() );
-	_strupr_s( version );
-	sprintf_s( tmpBuf, sizeof( tmpBuf ), "SHADER_MODEL_%6.6s", version );
-
-	command.defines.emplace_back( String( tmpBuf ), "1" );
+	char* const pComboNumberEnd = std::to_chars( std::begin( command.comboNumber ), std::end( command.comboNumber ) - 1, m_iComboNumber, 16 ).ptr;
+	*pComboNumberEnd = 0;
+	command.defines.emplace_back( "SHADERCOMBO", std::string_view( command.comboNumber, pComboNumberEnd - command.comboNumber ) );
+	command.defines.emplace_back( m_pEntry->m_szShaderModelDefine, "1" );
 
 	for ( pSetValues = pnValues, pSetDef = pDefVars; pSetValues < pnValuesEnd && pDefVars < pDefVarsEnd; ++pSetValues, ++pSetDef )
-	{
-		*std::to_chars( std::begin( tmpBuf ), std::end( tmpBuf ), *pSetValues ).ptr = 0;
-		command.defines.emplace_back( pSetDef->Name(), String( tmpBuf ) );
-	}
-
-	return command;
+		command.defines.emplace_back( pSetDef->Name(), pSetDef->ValueText( *pSetValues ) );
 }
 
 void ComboHandleImpl::FormatCommandHumanReadable( gsl::span<char> pchBuffer ) const
 {
 	// Get the pointers
-	const int* const pnValues    = m_arrVarSlots.data();
-	const int* const pnValuesEnd = pnValues + m_arrVarSlots.size();
+	const int* const pnValues    = m_arrVarSlots;
+	const int* const pnValuesEnd = pnValues + m_nVarSlots;
 	const int* pSetValues;
 
 	// Defines
@@ -900,11 +1672,11 @@ void ComboHandleImpl::FormatCommandHumanReadable( gsl::span<char> pchBuffer ) co
 	const Define* pSetDef;
 
 	// ------- OnCombo( nCurrentCombo ); ----------
-	char version[20];
-	strcpy_s( version, sizeof( version ), m_pEntry->m_eiInfo.m_szShaderVersion.data() );
-	_strupr_s( version );
+	char version[20]{};
+	strcpy_s( version, sizeof( version ) - 1, m_pEntry->m_eiInfo.m_szShaderVersion.data() );
+	std::transform( std::begin( version ), std::end( version ), std::begin( version ), []( char c ) { return static_cast<char>( toupper( c ) ); } );
 	int o = sprintf_s( pchBuffer.data(), pchBuffer.size(),
-		"fxc /DCENTROIDMASK=%d /DSHADERCOMBO=%llx /DSHADER_MODEL_%s=1 /T%s /Emain",
+		"fxc /DCENTROIDMASK=%d /DSHADERCOMBO=%" PRIx64 " /DSHADER_MODEL_%s=1 /T%s /Emain",
 		m_pEntry->m_eiInfo.m_nCentroidMask, m_iComboNumber, version, m_pEntry->m_eiInfo.m_szShaderVersion.data() );
 
 	for ( pSetValues = pnValues, pSetDef = pDefVars; pSetValues < pnValuesEnd && pDefVars < pDefVarsEnd; ++pSetValues, ++pSetDef )
@@ -973,9 +1745,20 @@ static void SetupConfiguration( const std::vector<CfgProcessor::ShaderConfig>& c
 		info.m_szShaderFileName = cfg.m_szShaderSrc;
 		info.m_szShaderVersion = *s_strPool.emplace( baseTemplate ).first;
 		info.m_szEntryPoint = *s_strPool.emplace( conf.main ).first;
+
+		char version[16]{};
+		strcpy_s( version, sizeof( version ) - 1, info.m_szShaderVersion.data() );
+		std::transform( std::begin( version ), std::end( version ), std::begin( version ), []( char c ) { return static_cast<char>( toupper( c ) ); } );
+		char shaderModel[24]{};
+		sprintf_s( shaderModel, sizeof( shaderModel ), "SHADER_MODEL_%6.6s", version );
+		cfg.m_szShaderModelDefine = *s_strPool.emplace( shaderModel ).first;
 		info.m_numCombos = cg.NumCombos();
 		info.m_numDynamicCombos = cg.NumCombos( false );
 		info.m_numStaticCombos = cg.NumCombos( true );
+		cfg.m_skipCounts.Count( cg, exprSkip );
+		info.m_numNonSkippedCombos = cfg.m_skipCounts.NumCombos();
+		info.m_numNonSkippedStaticCombos = cfg.m_skipCounts.NumStaticCombos();
+		info.m_bNonSkippedExact = cfg.m_skipCounts.IsExact();
 		info.m_nCentroidMask = conf.centroid_mask;
 		info.m_nCrc32 = conf.crc32;
 
@@ -1004,25 +1787,13 @@ static void SetupConfiguration( const std::vector<CfgProcessor::ShaderConfig>& c
 		fileCache.Add( file, std::move( data ) );
 	}
 
+	// Any command decodes straight into define values, all we need is where every entry starts
 	uint64_t nCurrentCommand = 0;
+	s_arrCommandRanges.reserve( s_setEntries.size() + 1 );
 	for ( auto it = s_setEntries.rbegin(), itEnd = s_setEntries.rend(); it != itEnd; ++it )
 	{
-		// We establish a command mapping for the beginning of the entry
-		ComboHandleImpl chi;
-		chi.Initialize( nCurrentCommand, &*it );
-		s_mapComboCommands.emplace( nCurrentCommand, chi );
-
-		// We also establish mapping by either splitting the
-		// combos into 500 intervals or stepping by every 1000 combos.
-		const uint64_t iPartStep = std::max( 1000ULL, chi.m_numCombos / 500 );
-		for ( uint64_t iRecord = nCurrentCommand + iPartStep; iRecord < nCurrentCommand + chi.m_numCombos; iRecord += iPartStep )
-		{
-			uint64_t iAdvance = iPartStep;
-			chi.AdvanceCommands( iAdvance );
-			s_mapComboCommands.emplace( iRecord, chi );
-		}
-
-		nCurrentCommand += chi.m_numCombos;
+		s_arrCommandRanges.emplace_back( CommandRange{ nCurrentCommand, &*it } );
+		nCurrentCommand += it->m_pCg->NumCombos();
 	}
 
 	// Establish the last command terminator
@@ -1031,10 +1802,7 @@ static void SetupConfiguration( const std::vector<CfgProcessor::ShaderConfig>& c
 		s_term.m_eiInfo.m_iCommandStart = s_term.m_eiInfo.m_iCommandEnd = nCurrentCommand;
 		s_term.m_eiInfo.m_numCombos = s_term.m_eiInfo.m_numStaticCombos = s_term.m_eiInfo.m_numDynamicCombos = 1;
 		s_term.m_eiInfo.m_szName = s_term.m_eiInfo.m_szShaderFileName = s_term.m_eiInfo.m_szEntryPoint = "";
-		ComboHandleImpl chi;
-		chi.m_iTotalCommand = nCurrentCommand;
-		chi.m_pEntry = &s_term;
-		s_mapComboCommands.emplace( nCurrentCommand, chi );
+		s_arrCommandRanges.emplace_back( CommandRange{ nCurrentCommand, &s_term } );
 	}
 }
 }; // namespace ConfigurationProcessing
@@ -1051,6 +1819,33 @@ static ComboHandle AsHandle( CPCHI_t* pImpl ) noexcept
 	return reinterpret_cast<ComboHandle>( pImpl );
 }
 
+// Handles are recycled by the thread which frees them, so handing out
+// and dropping handles per chunk of commands doesn't touch the heap
+class CComboHandlePool
+{
+public:
+	~CComboHandlePool()
+	{
+		for ( uint32_t i = 0; i < m_nFree; ++i )
+			delete m_arrFree[i];
+	}
+
+	CPCHI_t* Alloc() noexcept { return m_nFree ? m_arrFree[--m_nFree] : new( std::nothrow ) CPCHI_t; }
+	void Free( CPCHI_t* pImpl ) noexcept
+	{
+		if ( m_nFree < PoolSize )
+			m_arrFree[m_nFree++] = pImpl;
+		else
+			delete pImpl;
+	}
+
+private:
+	static constexpr uint32_t PoolSize = 16;
+	CPCHI_t* m_arrFree[PoolSize];
+	uint32_t m_nFree = 0;
+};
+static thread_local CComboHandlePool s_tlHandlePool;
+
 void SetupConfiguration( const std::vector<ShaderConfig>& configs, const std::filesystem::path& root, bool bVerbose )
 {
 	ConfigurationProcessing::SetupConfiguration( configs, root, bVerbose );
@@ -1080,49 +1875,30 @@ std::unique_ptr<CfgProcessor::CfgEntryInfo[]> DescribeConfiguration( bool bPrint
 	}
 
 	// Terminator
-	memset( pInfo, 0, sizeof( CfgEntryInfo ) );
+	*pInfo = {};
 	pInfo->m_iCommandStart = nCurrentCommand;
 	pInfo->m_iCommandEnd   = nCurrentCommand;
 
 	return arrEntries;
 }
 
-static const CPCHI_t& GetLessOrEq( uint64_t& k, const CPCHI_t& v )
+void SetEntryContext( CfgEntryInfo& entry, ShaderCompileContext* pContext ) noexcept
 {
-	auto it = ConfigurationProcessing::s_mapComboCommands.lower_bound( k );
-	if ( ConfigurationProcessing::s_mapComboCommands.end() == it )
-	{
-		if ( ConfigurationProcessing::s_mapComboCommands.empty() )
-			return v;
-		--it;
-	}
-
-	if ( k < it->first )
-	{
-		if ( ConfigurationProcessing::s_mapComboCommands.begin() == it )
-			return v;
-		--it;
-	}
-
-	k = it->first;
-	return it->second;
+	entry.m_pContext = pContext;
+	if ( const ConfigurationProcessing::CommandRange* pRange = ConfigurationProcessing::FindCommandRange( entry.m_iCommandStart ) )
+		const_cast<CfgEntryInfo&>( pRange->m_pEntry->m_eiInfo ).m_pContext = pContext;
 }
 
 ComboHandle Combo_GetCombo( uint64_t iCommandNumber )
 {
-	// Find earlier command
-	uint64_t iCommandFound = iCommandNumber;
-	const CPCHI_t emptyCPCHI;
-	const CPCHI_t& chiFound = GetLessOrEq( iCommandFound, emptyCPCHI );
-
-	if ( chiFound.m_iTotalCommand < 0 || chiFound.m_iTotalCommand > iCommandNumber )
+	const ConfigurationProcessing::CommandRange* pRange = ConfigurationProcessing::FindCommandRange( iCommandNumber );
+	if ( !pRange )
 		return nullptr;
 
-	// Advance the handle as needed
-	CPCHI_t* pImpl = new CPCHI_t( chiFound );
-
-	uint64_t iCommandFoundAdvance = iCommandNumber - iCommandFound;
-	pImpl->AdvanceCommands( iCommandFoundAdvance );
+	CPCHI_t* pImpl = s_tlHandlePool.Alloc();
+	if ( !pImpl )
+		return nullptr;
+	pImpl->Initialize( iCommandNumber, pRange->m_iCommandStart, pRange->m_pEntry );
 
 	return AsHandle( pImpl );
 }
@@ -1135,21 +1911,14 @@ void Combo_GetNext( uint64_t& riCommandNumber, ComboHandle& rhCombo, uint64_t iC
 	if ( !rhCombo )
 	{
 		// We don't have a combo handle that corresponds to the command
-
-		// Find earlier command
-		uint64_t iCommandFound = riCommandNumber;
-		const CPCHI_t emptyCPCHI;
-		const CPCHI_t& chiFound = GetLessOrEq( iCommandFound, emptyCPCHI );
-
-		if ( !chiFound.m_pEntry || !chiFound.m_pEntry->m_pCg || !chiFound.m_pEntry->m_pExpr || chiFound.m_iTotalCommand < 0 || chiFound.m_iTotalCommand > riCommandNumber )
+		const ConfigurationProcessing::CommandRange* pRange = ConfigurationProcessing::FindCommandRange( riCommandNumber );
+		if ( !pRange || !pRange->m_pEntry->m_pCg || !pRange->m_pEntry->m_pExpr )
 			return;
 
-		// Advance the handle as needed
-		pImpl   = new CPCHI_t( chiFound );
+		if ( ( pImpl = s_tlHandlePool.Alloc() ) == nullptr )
+			return;
 		rhCombo = AsHandle( pImpl );
-
-		uint64_t iCommandFoundAdvance = riCommandNumber - iCommandFound;
-		pImpl->AdvanceCommands( iCommandFoundAdvance );
+		pImpl->Initialize( riCommandNumber, pRange->m_iCommandStart, pRange->m_pEntry );
 
 		if ( !pImpl->IsSkipped() )
 			return;
@@ -1167,38 +1936,30 @@ void Combo_GetNext( uint64_t& riCommandNumber, ComboHandle& rhCombo, uint64_t iC
 		// We failed to get the next combo command (out of range)
 		if ( pImpl->m_iTotalCommand + 1 >= iCommandEnd )
 		{
-			delete pImpl;
+			s_tlHandlePool.Free( pImpl );
 			rhCombo         = nullptr;
 			riCommandNumber = iCommandEnd;
 			return;
 		}
 
-		// Otherwise we just have to obtain the next combo handle
+		// Otherwise we just have to move on to the next entry
 		riCommandNumber = pImpl->m_iTotalCommand + 1;
 
-		// Delete the old combo handle
-		delete pImpl;
-		rhCombo = nullptr;
-
-		// Retrieve the next combo handle data
-		uint64_t iCommandLookup = riCommandNumber;
-		CPCHI_t emptyCPCHI;
-		const CPCHI_t& chiNext = GetLessOrEq( iCommandLookup, emptyCPCHI );
-		Assert( iCommandLookup == riCommandNumber && ( chiNext.m_pEntry ) );
+		const ConfigurationProcessing::CommandRange* pRange = ConfigurationProcessing::FindCommandRange( riCommandNumber );
+		Assert( pRange && pRange->m_iCommandStart == riCommandNumber && pRange->m_pEntry->m_pCg );
 
-		// Set up the new combo handle
-		pImpl   = new CPCHI_t( chiNext );
-		rhCombo = AsHandle( pImpl );
+		// Reuse the combo handle for the new entry
+		pImpl->Initialize( riCommandNumber, pRange->m_iCommandStart, pRange->m_pEntry );
 
 		if ( !pImpl->IsSkipped() )
 			return;
 	}
 }
 
-ComboBuildCommand Combo_BuildCommand( ComboHandle hCombo )
+void Combo_BuildCommand( ComboHandle hCombo, ComboBuildCommand& command )
 {
 	const auto pImpl = FromHandle( hCombo );
-	return pImpl->BuildCommand();
+	pImpl->BuildCommand( command );
 }
 
 void Combo_FormatCommandHumanReadable( ComboHandle hCombo, gsl::span<char> pchBuffer )
@@ -1228,11 +1989,39 @@ const CfgEntryInfo* Combo_GetEntryInfo( ComboHandle hCombo ) noexcept
 	return nullptr;
 }
 
+uint64_t GetNonSkippedDynamicCombos( const CfgEntryInfo* pEntry, uint64_t nStaticCombo ) noexcept
+{
+	const ConfigurationProcessing::CommandRange* pRange = ConfigurationProcessing::FindCommandRange( pEntry->m_iCommandStart );
+	if ( !pRange || !pRange->m_pEntry->m_pCg )
+		return 0;
+	return pRange->m_pEntry->m_skipCounts.NumDynamicCombos( nStaticCombo );
+}
+
+uint64_t GetStaticComboEnd( uint64_t iCommandNumber ) noexcept
+{
+	const ConfigurationProcessing::CommandRange* pRange = ConfigurationProcessing::FindCommandRange( iCommandNumber );
+	if ( !pRange || !pRange->m_pEntry->m_pCg )
+		return iCommandNumber + 1;
+
+	// Commands go from the last combo down, so every static combo is a run of dynamic combos
+	const uint64_t nDynamicCombos = std::max<uint64_t>( pRange->m_pEntry->m_eiInfo.m_numDynamicCombos, 1 );
+	return pRange->m_iCommandStart + ( ( iCommandNumber - pRange->m_iCommandStart ) / nDynamicCombos + 1 ) * nDynamicCombos;
+}
+
+const CfgEntryInfo* GetCommandEntry( uint64_t iCommandNumber ) noexcept
+{
+	const ConfigurationProcessing::CommandRange* pRange = ConfigurationProcessing::FindCommandRange( iCommandNumber );
+	if ( !pRange || !pRange->m_pEntry->m_pCg )
+		return nullptr;
+	return &pRange->m_pEntry->m_eiInfo;
+}
+
 ComboHandle Combo_Alloc( ComboHandle hComboCopyFrom ) noexcept
 {
-	if ( hComboCopyFrom )
-		return AsHandle( new CPCHI_t( *FromHandle( hComboCopyFrom ) ) );
-	return AsHandle( new( std::nothrow ) CPCHI_t );
+	CPCHI_t* pImpl = s_tlHandlePool.Alloc();
+	if ( pImpl )
+		*pImpl = hComboCopyFrom ? *FromHandle( hComboCopyFrom ) : CPCHI_t{};
+	return AsHandle( pImpl );
 }
 
 void Combo_Assign( ComboHandle hComboDst, ComboHandle hComboSrc )
@@ -1243,7 +2032,8 @@ void Combo_Assign( ComboHandle hComboDst, ComboHandle hComboSrc )
 
 void Combo_Free( ComboHandle& rhComboFree ) noexcept
 {
-	delete FromHandle( rhComboFree );
+	if ( rhComboFree )
+		s_tlHandlePool.Free( FromHandle( rhComboFree ) );
 	rhComboFree = nullptr;
 }
 }; // namespace CfgProcessor
\ No newline at end of file
@@ -21,6 +21,9 @@ namespace Parser
 	struct Combo;
 }
 
+// Per-shader state of the compile pipeline, opaque here
+struct ShaderCompileContext;
+
 /*
 
 Layout of the internal structures is as follows:
@@ -66,14 +69,24 @@ struct CfgEntryInfo
 	uint64_t			m_numCombos;			// Total possible num of combos, e.g. 1024
 	uint64_t			m_numDynamicCombos;		// Num of dynamic combos, e.g. 4
 	uint64_t			m_numStaticCombos;		// Num of static combos, e.g. 256
+	uint64_t			m_numNonSkippedCombos;	// Num of combos left after SKIP, e.g. 700
+	uint64_t			m_numNonSkippedStaticCombos; // Num of static combos with any combo left after SKIP, e.g. 200
+	bool				m_bNonSkippedExact;		// False if the shader had too many combos to count, the two above are upper bounds then
 	uint64_t			m_iCommandStart;		// Start command, e.g. 0
 	uint64_t			m_iCommandEnd;			// End command, e.g. 1024
 	int					m_nCentroidMask;		// Mask of centroid samplers
 	uint32_t			m_nCrc32;
+	ShaderCompileContext* m_pContext;			// Compile state of the shader, see SetEntryContext
 };
 
 std::unique_ptr<CfgProcessor::CfgEntryInfo[]> DescribeConfiguration( bool bPrintExpressions );
 
+// Attaches the context to the entry and to the entry info seen through its combo handles
+void SetEntryContext( CfgEntryInfo& entry, ShaderCompileContext* pContext ) noexcept;
+
+// Most defines a shader can have, combo handles keep the values inline
+inline constexpr size_t MaxComboDefines = 64;
+
 // Working with combos
 struct __ComboHandle
 {
@@ -88,14 +101,30 @@ uint64_t Combo_GetCommandNum( ComboHandle hCombo ) noexcept;
 uint64_t Combo_GetComboNum( ComboHandle hCombo ) noexcept;
 const CfgEntryInfo* Combo_GetEntryInfo( ComboHandle hCombo ) noexcept;
 
+// Num of dynamic combos left after SKIP in the static combo of the entry
+uint64_t GetNonSkippedDynamicCombos( const CfgEntryInfo* pEntry, uint64_t nStaticCombo ) noexcept;
+
+// First command past the static combo of the command, commands outside of entries are on their own
+uint64_t GetStaticComboEnd( uint64_t iCommandNumber ) noexcept;
+
+// Entry of the command, null outside of entries
+const CfgEntryInfo* GetCommandEntry( uint64_t iCommandNumber ) noexcept;
+
 struct ComboBuildCommand
 {
+	ComboBuildCommand() = default;
+	ComboBuildCommand( const ComboBuildCommand& ) = delete;
+	ComboBuildCommand& operator=( const ComboBuildCommand& ) = delete;
+
 	std::string_view entryPoint;
 	std::string_view fileName;
 	std::string_view shaderModel;
-	std::vector<std::pair<std::string_view, std::string_view>> defines;
+	std::vector<std::pair<std::string_view, std::string_view>> defines; // null terminated views
+
+	char comboNumber[24]; // SHADERCOMBO value, defines point into it
 };
-ComboBuildCommand Combo_BuildCommand( ComboHandle hCombo );
+// Overwrites command in place, keep one per thread around to build commands without allocating
+void Combo_BuildCommand( ComboHandle hCombo, ComboBuildCommand& command );
 
 ComboHandle Combo_Alloc( ComboHandle hComboCopyFrom ) noexcept;
 void Combo_Assign( ComboHandle hComboDst, ComboHandle hComboSrc );
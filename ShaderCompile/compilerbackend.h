@@ -0,0 +1,76 @@
+//====== Copyright c 1996-2006, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: Compiler backend interface.
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+#include "cmdsink.h"
+
+namespace CfgProcessor
+{
+	struct ComboBuildCommand;
+}
+
+namespace Compiler
+{
+	// Compile flags, values match D3DCOMPILE_* so they can be passed to D3DCompile as is
+	enum Flags : uint32_t
+	{
+		COMPILE_DEBUG                          = 1 << 0,
+		COMPILE_SKIP_VALIDATION                = 1 << 1,
+		COMPILE_SKIP_OPTIMIZATION              = 1 << 2,
+		COMPILE_PACK_MATRIX_ROW_MAJOR          = 1 << 3,
+		COMPILE_PACK_MATRIX_COLUMN_MAJOR       = 1 << 4,
+		COMPILE_PARTIAL_PRECISION              = 1 << 5,
+		COMPILE_FORCE_VS_SOFTWARE_NO_OPT       = 1 << 6,
+		COMPILE_FORCE_PS_SOFTWARE_NO_OPT       = 1 << 7,
+		COMPILE_NO_PRESHADER                   = 1 << 8,
+		COMPILE_AVOID_FLOW_CONTROL             = 1 << 9,
+		COMPILE_PREFER_FLOW_CONTROL            = 1 << 10,
+		COMPILE_ENABLE_STRICTNESS              = 1 << 11,
+		COMPILE_ENABLE_BACKWARDS_COMPATIBILITY = 1 << 12,
+		COMPILE_IEEE_STRICTNESS                = 1 << 13,
+		COMPILE_OPTIMIZATION_LEVEL0            = 1 << 14,
+		COMPILE_OPTIMIZATION_LEVEL1            = 0,
+		COMPILE_OPTIMIZATION_LEVEL2            = ( 1 << 14 ) | ( 1 << 15 ),
+		COMPILE_OPTIMIZATION_LEVEL3            = 1 << 15,
+		COMPILE_DEBUG_NAME_FOR_SOURCE          = 1 << 22,
+	};
+
+	/*
+
+	class ICompilerBackend
+
+	Compiles a single combo. Called concurrently from all worker threads.
+
+	*/
+	class ICompilerBackend
+	{
+	public:
+		virtual ~ICompilerBackend() = default;
+
+		virtual std::unique_ptr<CmdSink::IResponse> ExecuteCommand( const CfgProcessor::ComboBuildCommand& pCommand, uint32_t flags ) = 0;
+	};
+
+	// Produces repeatable pseudo-bytecode from the combo defines without compiling anything,
+	// to profile scheduling, packaging and writing on machines without the D3D compiler.
+	// szConfig is a comma separated list of key=value pairs:
+	//   seed=N            mixed into every combo hash
+	//   latency=US        average time spent on each combo, microseconds (busy wait)
+	//   jitter=US         maximum deviation from latency, microseconds
+	//   size=MIN-MAX      bytecode size range, bytes
+	//   dist=uniform|log  bytecode size distribution within the range
+	//   fail=P            fraction of combos which fail to compile
+	//   warn=P            fraction of combos which report a warning
+	//   dup=P             fraction of define values the bytecode ignores, static combos then repeat
+	// Returns nullptr and prints the reason if the config can't be parsed.
+	std::unique_ptr<ICompilerBackend> CreateSyntheticBackend( std::string_view szConfig );
+}; // namespace Compiler
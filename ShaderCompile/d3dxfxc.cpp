@@ -32,36 +32,6 @@
 
 #pragma comment( lib, "D3DCompiler" )
 
-CSharedFile::CSharedFile( std::vector<char>&& data ) noexcept : std::vector<char>( std::forward<std::vector<char>>( data ) )
-{
-}
-
-void FileCache::Add( const std::string& fileName, std::vector<char>&& data )
-{
-	const auto& it = m_map.find( fileName );
-	if ( it != m_map.end() )
-		return;
-
-	CSharedFile file( std::forward<std::vector<char>>( data ) );
-	m_map.emplace( fileName, std::move( file ) );
-}
-
-const CSharedFile* FileCache::Get( const std::string& filename ) const
-{
-	// Search the cache first
-	const auto find = m_map.find( filename );
-	if ( find != m_map.cend() )
-		return &find->second;
-	return nullptr;
-}
-
-void FileCache::Clear()
-{
-	m_map.clear();
-}
-
-FileCache fileCache;
-
 static struct DxIncludeImpl final : public ID3DInclude
 {
 	STDMETHOD( Open )( THIS_ D3D_INCLUDE_TYPE, LPCSTR pFileName, LPCVOID, LPCVOID* ppData, UINT* pBytes ) override
@@ -359,12 +329,44 @@ bool IsTargetEqual(std::string_view target, std::string_view expected) noexcept
 #endif  // SC_BUILD_PS1_X_COMPILER
 
 
-std::unique_ptr<CmdSink::IResponse> Compiler::ExecuteCommand( const CfgProcessor::ComboBuildCommand& pCommand, unsigned int flags )
+static_assert( Compiler::COMPILE_DEBUG == D3DCOMPILE_DEBUG );
+static_assert( Compiler::COMPILE_SKIP_VALIDATION == D3DCOMPILE_SKIP_VALIDATION );
+static_assert( Compiler::COMPILE_SKIP_OPTIMIZATION == D3DCOMPILE_SKIP_OPTIMIZATION );
+static_assert( Compiler::COMPILE_PACK_MATRIX_ROW_MAJOR == D3DCOMPILE_PACK_MATRIX_ROW_MAJOR );
+static_assert( Compiler::COMPILE_PACK_MATRIX_COLUMN_MAJOR == D3DCOMPILE_PACK_MATRIX_COLUMN_MAJOR );
+static_assert( Compiler::COMPILE_PARTIAL_PRECISION == D3DCOMPILE_PARTIAL_PRECISION );
+static_assert( Compiler::COMPILE_FORCE_VS_SOFTWARE_NO_OPT == D3DCOMPILE_FORCE_VS_SOFTWARE_NO_OPT );
+static_assert( Compiler::COMPILE_FORCE_PS_SOFTWARE_NO_OPT == D3DCOMPILE_FORCE_PS_SOFTWARE_NO_OPT );
+static_assert( Compiler::COMPILE_NO_PRESHADER == D3DCOMPILE_NO_PRESHADER );
+static_assert( Compiler::COMPILE_AVOID_FLOW_CONTROL == D3DCOMPILE_AVOID_FLOW_CONTROL );
+static_assert( Compiler::COMPILE_PREFER_FLOW_CONTROL == D3DCOMPILE_PREFER_FLOW_CONTROL );
+static_assert( Compiler::COMPILE_ENABLE_STRICTNESS == D3DCOMPILE_ENABLE_STRICTNESS );
+static_assert( Compiler::COMPILE_ENABLE_BACKWARDS_COMPATIBILITY == D3DCOMPILE_ENABLE_BACKWARDS_COMPATIBILITY );
+static_assert( Compiler::COMPILE_IEEE_STRICTNESS == D3DCOMPILE_IEEE_STRICTNESS );
+static_assert( Compiler::COMPILE_OPTIMIZATION_LEVEL0 == D3DCOMPILE_OPTIMIZATION_LEVEL0 );
+static_assert( Compiler::COMPILE_OPTIMIZATION_LEVEL1 == D3DCOMPILE_OPTIMIZATION_LEVEL1 );
+static_assert( Compiler::COMPILE_OPTIMIZATION_LEVEL2 == D3DCOMPILE_OPTIMIZATION_LEVEL2 );
+static_assert( Compiler::COMPILE_OPTIMIZATION_LEVEL3 == D3DCOMPILE_OPTIMIZATION_LEVEL3 );
+static_assert( Compiler::COMPILE_DEBUG_NAME_FOR_SOURCE == D3DCOMPILE_DEBUG_NAME_FOR_SOURCE );
+
+class CD3DCompilerBackend final : public Compiler::ICompilerBackend
+{
+public:
+	std::unique_ptr<CmdSink::IResponse> ExecuteCommand( const CfgProcessor::ComboBuildCommand& pCommand, uint32_t flags ) override;
+};
+
+std::unique_ptr<Compiler::ICompilerBackend> Compiler::CreateD3DBackend()
+{
+	return std::make_unique<CD3DCompilerBackend>();
+}
+
+std::unique_ptr<CmdSink::IResponse> CD3DCompilerBackend::ExecuteCommand( const CfgProcessor::ComboBuildCommand& pCommand, uint32_t flags )
 {
-	// Macros to be defined for D3DX
-	std::vector<D3D_SHADER_MACRO> macros;
+	// Macros to be defined for D3DX, kept per thread so they are only allocated once
+	static thread_local std::vector<D3D_SHADER_MACRO> macros;
 	macros.resize( pCommand.defines.size() + 1 );
 	std::transform( pCommand.defines.cbegin(), pCommand.defines.cend(), macros.begin(), []( const auto& d ) { return D3D_SHADER_MACRO{ d.first.data(), d.second.data() }; } );
+	macros.back() = D3D_SHADER_MACRO{ nullptr, nullptr };
 
 	ID3DBlob* pShader        = nullptr; // NOTE: Must release the COM interface later
 	ID3DBlob* pErrorMessages = nullptr; // NOTE: Must release COM interface later
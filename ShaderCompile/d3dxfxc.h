@@ -11,46 +11,11 @@
 #include <memory>
 
 #include "basetypes.h"
-#include "cmdsink.h"
-
-#include "robin_hood.h"
-
-class CSharedFile final : private std::vector<char>
-{
-public:
-	CSharedFile( std::vector<char>&& data ) noexcept;
-	using std::vector<char>::vector;
-	~CSharedFile() = default;
-
-	[[nodiscard]] const void* Data() const noexcept { return data(); }
-	[[nodiscard]] size_t Size() const noexcept { return size(); }
-};
-
-class FileCache final
-{
-public:
-	FileCache() = default;
-	~FileCache() { Clear(); }
-
-	void Add( const std::string& fileName, std::vector<char>&& data );
-
-	[[nodiscard]] const CSharedFile* Get( const std::string& filename ) const;
-
-	void Clear();
-
-protected:
-	typedef robin_hood::unordered_node_map<std::string, CSharedFile> Mapping;
-	Mapping m_map;
-};
-
-extern FileCache fileCache;
-
-namespace CfgProcessor
-{
-	struct ComboBuildCommand;
-}
+#include "compilerbackend.h"
+#include "filecache.h"
 
 namespace Compiler
 {
-	std::unique_ptr<CmdSink::IResponse> ExecuteCommand( const CfgProcessor::ComboBuildCommand& pCommand, unsigned int flags );
-}; // namespace InterceptFxc
\ No newline at end of file
+	// D3DCompile/D3DXCompileShader, only available on Windows
+	std::unique_ptr<ICompilerBackend> CreateD3DBackend();
+}; // namespace Compiler
\ No newline at end of file
@@ -0,0 +1,39 @@
+//====== Copyright c 1996-2006, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: In-memory cache of shader sources handed to the compiler.
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include "filecache.h"
+
+CSharedFile::CSharedFile( std::vector<char>&& data ) noexcept : std::vector<char>( std::forward<std::vector<char>>( data ) )
+{
+}
+
+void FileCache::Add( const std::string& fileName, std::vector<char>&& data )
+{
+	const auto& it = m_map.find( fileName );
+	if ( it != m_map.end() )
+		return;
+
+	CSharedFile file( std::forward<std::vector<char>>( data ) );
+	m_map.emplace( fileName, std::move( file ) );
+}
+
+const CSharedFile* FileCache::Get( const std::string& filename ) const
+{
+	// Search the cache first
+	const auto find = m_map.find( filename );
+	if ( find != m_map.cend() )
+		return &find->second;
+	return nullptr;
+}
+
+void FileCache::Clear()
+{
+	m_map.clear();
+}
+
+FileCache fileCache;
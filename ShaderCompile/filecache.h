@@ -0,0 +1,46 @@
+//====== Copyright c 1996-2006, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: In-memory cache of shader sources handed to the compiler.
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#pragma once
+
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "robin_hood.h"
+
+class CSharedFile final : private std::vector<char>
+{
+public:
+	CSharedFile( std::vector<char>&& data ) noexcept;
+	using std::vector<char>::vector;
+	~CSharedFile() = default;
+
+	[[nodiscard]] const void* Data() const noexcept { return data(); }
+	[[nodiscard]] size_t Size() const noexcept { return size(); }
+};
+
+class FileCache final
+{
+public:
+	FileCache() = default;
+	~FileCache() { Clear(); }
+
+	void Add( const std::string& fileName, std::vector<char>&& data );
+
+	[[nodiscard]] const CSharedFile* Get( const std::string& filename ) const;
+
+	void Clear();
+
+protected:
+	typedef robin_hood::unordered_node_map<std::string, CSharedFile> Mapping;
+	Mapping m_map;
+};
+
+extern FileCache fileCache;
@@ -816,7 +816,7 @@ bool ezOptionValidator::isValid( const std::string* valueAsString )
 #define VALIDATE( T, U, LIST )                                                                  \
 	{                                                                                           \
 		/* Value string converted to true native type. */                                       \
-		U v;                                                                                    \
+		U v{};                                                                                  \
 		std::from_chars( valueAsString->c_str(), valueAsString->c_str() + valueAsString->size(), v ); \
 		/* Check if within list. */                                                             \
 		if ( op == IN )                                                                         \
@@ -826,7 +826,7 @@ bool ezOptionValidator::isValid( const std::string* valueAsString )
 		}                                                                                       \
 																								\
 		/* Check if within user's custom range. */                                              \
-		T v0, v1;                                                                               \
+		T v0{}, v1{};                                                                           \
 		if ( size > 0 )                                                                         \
 		{                                                                                       \
 			v0 = LIST[0];                                                                       \
@@ -0,0 +1,441 @@
+//========= Copyright  1996-2005, Valve Corporation, All rights reserved. ============//
+//
+// Purpose:
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+// main.cpp : Defines the entry point for the console application.
+//
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <unordered_map>
+
+#include "basetypes.h"
+#include "compilerbackend.h"
+#include "platform.h"
+#include "shadercompile.h"
+#include "shaderparser.h"
+#ifdef _WIN32
+#include "d3dxfxc.h"
+#endif
+
+#include "ezOptionParser.hpp"
+#include "termcolor/style.hpp"
+#include "gsl/narrow"
+#include "robin_hood.h"
+
+#include "termcolors.hpp"
+#include "strmanip.hpp"
+#include "scopednewhandler.hpp"
+
+namespace fs = std::filesystem;
+namespace chrono = std::chrono;
+using std::chrono::duration_cast;
+using namespace std::literals;
+
+static bool s_write = true;
+static void CtrlHandler()
+{
+	s_write = false;
+	StopCompileShaders();
+	PrintCompileErrors( false );
+	Platform::KeepSystemAwake( false );
+}
+
+static void WriteStats( bool skipWarnings )
+{
+	if ( s_write )
+		PrintCompileErrors( skipWarnings );
+
+	//
+	// End
+	//
+	const Clock::time_point end = Clock::now();
+
+	std::cout << "\r"sv << clr::green << FormatTime( duration_cast<chrono::seconds>( end - g_flStartTime ).count() ) << clr::reset << " elapsed"sv << std::endl;
+}
+
+static constexpr const char* const validTypes[] =
+{
+	"vs", "ps", "gs", "ds", "hs"
+};
+
+static constexpr const char* const validBackends[] =
+{
+#ifdef _WIN32
+	"d3d",
+#endif
+	"synthetic"
+};
+
+static constexpr const char* const validModels[] =
+{
+#if defined(SC_BUILD_PS1_X_COMPILER)
+    "11",
+    "12",
+    "13",
+    "14",
+#endif  // SC_BUILD_PS1_X_COMPILER
+	"20b", "30", "40", "41", "50", "51"
+};
+
+void OnNewOrMallocFailure() noexcept
+{
+	std::cerr << clr::red << clr::bold
+			  << "ERROR: Failed to allocate memory. Please close other processes and retry."
+			  << clr::reset
+			  << std::endl;
+	exit( ENOMEM );
+}
+
+int main( int argc, const char* argv[] )
+{
+	const ScopedNewHandler scopedNewHandler{ OnNewOrMallocFailure };
+
+	{
+		if ( Platform::EnableConsoleColors() )
+			std::cout << clr::colorize;
+		else
+			std::cout << clr::nocolorize;
+		Platform::SetInterruptHandler( CtrlHandler );
+	}
+
+	bool parseLegacy = false;
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( !Platform::StrICmp( argv[i], "-nompi" ) || !Platform::StrICmp( argv[i], "-nop4" ) )
+		{
+			parseLegacy = true;
+			break;
+		}
+	}
+
+	ez::ezOptionParser cmdLine{};
+	cmdLine.overview = "Source shader compiler.";
+	cmdLine.syntax   = "ShaderCompile [OPTIONS] file1.fxc [file2.fxc...]";
+	if ( parseLegacy )
+	{
+		cmdLine.add( "", true, 1, 0, "", "-game" );
+		cmdLine.add( "", true, 1, 0, "", "-shaderpath" );
+		cmdLine.add( "0", false, 1, 0, "", "-threads" );
+		cmdLine.add( "", false, 0, 0, "", "-nompi" );
+		cmdLine.add( "", false, 0, 0, "", "-nop4" );
+		cmdLine.add( "", false, 0, 0, "", "-allowdebug" );
+		cmdLine.add( "", false, 0, 0, "", "-types" );
+		cmdLine.add( "", false, 0, 0, "", "-ver" );
+	}
+	else
+	{
+		cmdLine.add( "", true, -1, ',', "Sets shader version", "-ver", "/ver", new ez::ezOptionValidator{ ez::ezOptionValidator::T, ez::ezOptionValidator::IN, validModels, std::size( validModels ), false } );
+		cmdLine.add( "", true, 1, 0, "Base path for shaders", "-shaderpath", "/shaderpath" );
+		cmdLine.add( "", false, 0, 0, "Skip crc check during compilation", "-force", "/force" );
+		cmdLine.add( "", false, 0, 0, "Calculate crc for shader", "-crc", "/crc" );
+		cmdLine.add( "", false, 0, 0, "Generate only header", "-dynamic", "/dynamic" );
+		cmdLine.add( "", false, 0, 0, "Stop on first error", "-fastfail", "/fastfail" );
+		cmdLine.add( "0", false, 1, 0, "Number of threads used, defaults to core count", "-threads", "/threads" );
+		cmdLine.add( "0", false, 1, 0, "Number of threads packing finished static combos, defaults to a quarter of threads", "-packthreads", "/packthreads" );
+		cmdLine.add( "", false, 0, 0, "Store combo blocks uncompressed, faster packaging for development builds", "-nocompress", "/nocompress" );
+		cmdLine.add( "4096", false, 1, 0, "Megabytes of compiled code held in memory before compiling waits for packaging, 0 for no limit", "-membudget", "/membudget" );
+		cmdLine.add( "0", false, 1, 0, "Megabytes of packed static combos a shader keeps in memory before spilling them to disk, 0 streams them to disk as they come", "-keeppacked", "/keeppacked" );
+		cmdLine.add( "", false, 0, 0, "Shows help", "-help", "-h", "/help", "/h" );
+
+		cmdLine.add( "", false, 0, 0, "Verbose file cache and final shader info", "-verbose", "/verbose" );
+		cmdLine.add( "", false, 0, 0, "Verbose compile commands", "-verbose2", "/verbose2" );
+		cmdLine.add( "", false, 0, 0, "Enables preprocessor debug printing", "-verbose_preprocessor" );
+
+		cmdLine.add( "", false, 0, 0, "Skips shader validation", "/Vd", "-no-validation" );
+		cmdLine.add( "", false, 0, 0, "Directs the compiler to not use flow-control constructs where possible", "/Gfa", "-no-flow-control" );
+		cmdLine.add( "", false, 0, 0, "Directs the compiler to use flow-control constructs where possible", "/Gfp", "-prefer-flow-control" );
+		cmdLine.add( "", false, 0, 0, "Disables shader optimization", "/Od", "-disable-optimization" );
+		cmdLine.add( "", false, 0, 0, "Enable debugging information", "/Zi", "-debug-info" );
+		cmdLine.add( "1", false, 1, 0, "Set optimization level (0-3)", "/O", "-optimize" );
+		cmdLine.add( "", false, -1, ',', "Set shader type, if compiling multiple different shaders, values can be separated by ','", "/T", "-types", new ez::ezOptionValidator{ ez::ezOptionValidator::T, ez::ezOptionValidator::IN, validTypes, std::size( validTypes ), false } );
+		cmdLine.add( "", false, 0, 0, "Generate ShaderComboSemantics_t and friends for shader", "-csgo", "/csgo" );
+
+		cmdLine.add( validBackends[0], false, 1, 0, "Compiler backend: d3d (Windows only) or synthetic", "-backend", "/backend", new ez::ezOptionValidator{ ez::ezOptionValidator::T, ez::ezOptionValidator::IN, validBackends, std::size( validBackends ), false } );
+		cmdLine.add( "", false, 1, 0, "Synthetic backend settings: seed=N,latency=US,jitter=US,size=MIN-MAX,dist=uniform|log,fail=P,warn=P,dup=P", "-synthetic", "/synthetic" );
+	}
+
+	cmdLine.parse( argc, argv );
+
+	if ( cmdLine.isSet( "-help" ) )
+	{
+		const uint32_t width = Platform::GetConsoleWidth();
+		std::string usage;
+		cmdLine.getUsageDescriptions( usage, width ? width : 80, ez::ezOptionParser::ALIGN );
+		std::cout << cmdLine.overview << "\n\n"
+				  << "Usage: "sv << cmdLine.syntax << "\n\n"sv
+				  << clr::green << clr::bold << "OPTIONS:\n"sv
+				  << clr::reset << usage << std::endl;
+		return 0;
+	}
+
+	g_flStartTime = Clock::now();
+
+	uint32_t flags = 0;
+	if ( cmdLine.isSet( "/Vd" ) )
+		flags |= Compiler::COMPILE_SKIP_VALIDATION;
+
+	// Flow control
+	if ( cmdLine.isSet( "/Gfa" ) )
+		flags |= Compiler::COMPILE_AVOID_FLOW_CONTROL;
+	else if ( cmdLine.isSet( "/Gfp" ) )
+		flags |= Compiler::COMPILE_PREFER_FLOW_CONTROL;
+
+	if ( cmdLine.isSet( "/Zi" ) )
+		flags |= Compiler::COMPILE_DEBUG | Compiler::COMPILE_DEBUG_NAME_FOR_SOURCE;
+
+	int optLevel = 1;
+	if ( !parseLegacy )
+		cmdLine.get( "/O" )->getInt( optLevel );
+	switch ( optLevel )
+	{
+	case 0:
+		flags |= Compiler::COMPILE_OPTIMIZATION_LEVEL0;
+		break;
+	default:
+		std::cout << "Unknown optimization level "sv << optLevel << ", using default!"sv << std::endl;
+		break;
+	case 1:
+		flags |= Compiler::COMPILE_OPTIMIZATION_LEVEL1;
+		break;
+	case 2:
+		flags |= Compiler::COMPILE_OPTIMIZATION_LEVEL2;
+		break;
+	case 3:
+		flags |= Compiler::COMPILE_OPTIMIZATION_LEVEL3;
+		break;
+	}
+
+	if ( std::vector<std::string> badOptions; !cmdLine.gotRequired( badOptions ) || ( !parseLegacy && cmdLine.lastArgs.size() < 1 ) )
+	{
+		std::cout << clr::red << clr::bold << "ERROR: Missing argument"sv << ( badOptions.size() == 1 ? ": "sv : "s:\n"sv ) << clr::reset;
+		for ( const auto& option : badOptions )
+			std::cout << option << std::endl;
+		std::cout << clr::reset << std::endl;
+		return -1;
+	}
+
+	if ( std::vector<std::string> badOptions; !cmdLine.gotExpected( badOptions ) )
+	{
+		std::cout << clr::red << clr::bold << "ERROR: Got unexpected number of arguments for option"sv << ( badOptions.size() == 1 ? ": "sv : "s:\n"sv ) << clr::reset;
+		for ( const auto& option : badOptions )
+			std::cout << option << std::endl;
+		std::cout << clr::reset << std::endl;
+		return -1;
+	}
+
+	if ( std::vector<std::string> badOptions, badArgs; !cmdLine.gotValid( badOptions, badArgs ) )
+	{
+		for (size_t i = 0; i < badOptions.size(); ++i )
+		std::cout << clr::red << clr::bold << "ERROR: Got invalid argument \""sv << badArgs[i] << "\" for option "sv << badOptions[i] << clr::reset << std::endl;
+		std::cout << clr::reset << std::endl;
+		return -1;
+	}
+
+	auto targets = cmdLine.get( "-types" );
+	auto versions = cmdLine.get( "-ver" );
+	if ( parseLegacy )
+		/*skip*/;
+	else if ( auto s = versions->args[0]->size(); s != 1 && s != cmdLine.lastArgs.size() )
+	{
+		std::cout << clr::red << clr::bold << "ERROR: Argument count for -ver doesn't match input shader count"sv << clr::reset;
+		return -1;
+	}
+
+	if ( auto s = targets->args.empty() ? 0 : targets->args[0]->size(); s > 1 && s != cmdLine.lastArgs.size() )
+	{
+		std::cout << clr::red << clr::bold << "ERROR: Argument count for -types doesn't match input shader count"sv << clr::reset;
+		return -1;
+	}
+
+	std::string path;
+	cmdLine.get( "-shaderpath" )->getString( path );
+	g_pShaderPath = fs::absolute( std::move( path ) );
+
+	if ( parseLegacy )
+	{
+		auto fileList = g_pShaderPath / "filelist.txt"sv;
+		if ( !fs::exists( fileList ) )
+		{
+			std::cout << clr::red << "Couldn't find filelist.txt in \""sv << g_pShaderPath << "\"!"sv << clr::reset << std::endl;
+			return -1;
+		}
+
+		struct hasher : std::hash<std::string_view>
+		{
+			using is_transparent = int;
+		};
+		struct equaler : std::equal_to<std::string_view>
+		{
+			using is_transparent = int;
+		};
+
+		std::unordered_multimap<std::string, std::string, hasher, equaler> files;
+
+		{
+			std::ifstream list( fileList );
+			std::string line, line2;
+			while ( std::getline( list, line ) )
+			{
+				if ( !line.starts_with( "#BEGIN "sv ) )
+					continue;
+				std::getline( list, line2 );
+				bool is30 = line.ends_with( "30"sv );
+				files.emplace( std::move( line2 ), line.substr( line.length() - ( is30 ? 2 : 3 ), is30 ? 2 : 3 ) );
+			}
+		}
+
+		robin_hood::unordered_set<std::string_view> unique;
+		for ( auto&& f : files )
+			unique.emplace( f.first );
+
+		// fake arguments
+		versions->args.emplace_back( new std::vector<std::string*> );
+		for ( auto&& f : unique )
+		{
+			robin_hood::unordered_set<std::string_view> added;
+			auto it = files.equal_range( f );
+			for ( auto s = it.first; s != it.second; ++s )
+			{
+				if ( !added.emplace( s->second ).second )
+					continue;
+				cmdLine.lastArgs.emplace_back( new std::string( s->first ) );
+				versions->args[0]->emplace_back( new std::string( s->second ) );
+			}
+		}
+
+		if ( cmdLine.lastArgs.empty() )
+		{
+			std::cout << clr::red << "filelist.txt doesn't contain any shaders!"sv << clr::reset << std::endl;
+			return -1;
+		}
+	}
+
+	std::set<ShaderInputData> files;
+	const bool noTargets = targets->args.empty() || targets->args[0]->empty();
+	for ( size_t i = 0, c = cmdLine.lastArgs.size(); i < c; ++i )
+	{
+		std::string_view version = versions->args[0]->size() == 1 ? *versions->args[0]->at( 0 ) : *versions->args[0]->at( i );
+		std::string_view target;
+		if ( noTargets )
+			target = Parser::GetTarget( *cmdLine.lastArgs[i] );
+		else
+			target = targets->args[0]->size() == 1 ? *targets->args[0]->at( 0 ) : *targets->args[0]->at( i );
+		if ( version == "20b"sv && target == "vs"sv )
+			version = "20"sv;
+		files.insert( ShaderInputData{ fs::path( *cmdLine.lastArgs[i] ).filename().string(), version, target } );
+	}
+
+	if ( cmdLine.isSet( "-crc" ) )
+	{
+		const auto root = g_pShaderPath.string();
+		for ( const auto& file : files )
+		{
+			const std::string name = Parser::ConstructName( file.name, file.target, file.version );
+			uint32_t crc = 0;
+			Parser::CheckCrc( g_pShaderPath / file.name, root, name, crc );
+			std::cout << crc << std::endl;
+		}
+		return 0;
+	}
+
+	const bool isCSGO = cmdLine.isSet( "-csgo" );
+	if ( cmdLine.isSet( "-dynamic" ) )
+	{
+		bool failed = false;
+		const auto root = g_pShaderPath.string();
+		for ( const auto& file : files )
+		{
+			CfgProcessor::ShaderConfig conf;
+			if ( !Parser::ParseFile( g_pShaderPath / file.name, root, file.target, file.version, conf ) )
+			{
+				std::cout << clr::red << "Failed to parse "sv << file.name << clr::reset << std::endl;
+				failed = true;
+			}
+			const std::string name = Parser::ConstructName( file.name, file.target, file.version );
+			Parser::WriteInclude( g_pShaderPath / "include"sv / ( name + ".inc" ), name, file.target, conf.static_c, conf.dynamic_c, conf.skip, isCSGO );
+		}
+		return failed ? -1 : 0;
+	}
+
+	std::unique_ptr<Compiler::ICompilerBackend> backend;
+	{
+		std::string backendName = validBackends[0];
+		if ( !parseLegacy )
+			cmdLine.get( "-backend" )->getString( backendName );
+		if ( backendName == "synthetic"sv )
+		{
+			std::string config;
+			cmdLine.get( "-synthetic" )->getString( config );
+			backend = Compiler::CreateSyntheticBackend( config );
+		}
+#ifdef _WIN32
+		else
+			backend = Compiler::CreateD3DBackend();
+#endif
+		if ( !backend )
+		{
+			std::cout << clr::red << clr::bold << "ERROR: Failed to create \""sv << backendName << "\" compiler backend"sv << clr::reset << std::endl;
+			return -1;
+		}
+	}
+
+	g_bVerbose = cmdLine.isSet( "-verbose" );
+	g_bVerbose2 = cmdLine.isSet( "-verbose2" );
+	g_bFastFail = cmdLine.isSet( "-fastfail" );
+	g_bNoCompress = !parseLegacy && cmdLine.isSet( "-nocompress" );
+
+	// Setting up the minidump handlers
+	Platform::InstallCrashHandler();
+	Platform::KeepSystemAwake( true );
+
+	auto entries = Shared_ParseListOfCompileCommands( std::move( files ), cmdLine.isSet( "-force" ), cmdLine.isSet( "-verbose_preprocessor" ), isCSGO );
+
+	unsigned long threads = 0, packThreads = 0;
+	cmdLine.get( "-threads" )->getULong( threads );
+	if ( !parseLegacy )
+	{
+		cmdLine.get( "-packthreads" )->getULong( packThreads );
+
+		unsigned long long memBudget = 0;
+		cmdLine.get( "-membudget" )->getULongLong( memBudget );
+		g_nMemoryBudget = memBudget << 20;
+
+		unsigned long long keepPacked = 0;
+		cmdLine.get( "-keeppacked" )->getULongLong( keepPacked );
+		g_nKeepPacked = keepPacked << 20;
+	}
+	CompileShaders( std::move( entries ), threads ? threads : std::thread::hardware_concurrency(), packThreads, *backend, flags );
+
+	WriteStats( parseLegacy );
+
+	if ( parseLegacy )
+	{
+		cmdLine.get( "-game" )->getString( path );
+		fs::path src = g_pShaderPath / "shaders"sv / "fxc"sv;
+		fs::path game = fs::absolute( std::move( path ) ) / "shaders"sv / "fxc"sv;
+		std::error_code c;
+		fs::create_directories( game, c );
+
+		for ( const std::string_view s : GetCompiledShaderNames() )
+		{
+			fs::path f = fs::path( s ).replace_extension( ".vcs" );
+			c.clear();
+			fs::copy_file( src / f, game / f, c );
+			if ( c )
+				std::cout << clr::red << "Coudn't copy "sv << f << " to game shader directory!"sv << clr::reset << std::endl;
+		}
+	}
+
+	Platform::KeepSystemAwake( false );
+
+	return gsl::narrow_cast<int>( GetNumFailedShaders() );
+}
@@ -0,0 +1,37 @@
+//====== Copyright c 1996-2007, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: Thin OS abstraction used by the shader compiler core and frontend.
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace Platform
+{
+	// Names the calling thread for debuggers and profilers.
+	void SetCurrentThreadName( std::string_view name );
+
+	// Switches console output to ANSI escape sequence processing.
+	// Returns false if the console can't display colors.
+	bool EnableConsoleColors();
+
+	// Returns width of the console window in characters, or 0 if unknown.
+	uint32_t GetConsoleWidth();
+
+	// Invokes handler once on Ctrl+C, then lets the process terminate as usual.
+	void SetInterruptHandler( void ( *handler )() );
+
+	// Writes a crash dump next to the executable on unhandled exceptions where supported.
+	void InstallCrashHandler();
+
+	// Prevents the system from going to sleep while the compilation is running.
+	void KeepSystemAwake( bool bAwake );
+
+	// Case-insensitive ASCII string comparison.
+	int StrICmp( const char* a, const char* b ) noexcept;
+} // namespace Platform
@@ -0,0 +1,80 @@
+//====== Copyright c 1996-2007, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: POSIX implementation of the platform layer.
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <csignal>
+#include <pthread.h>
+#include <strings.h>
+#include <sys/ioctl.h>
+#include <thread>
+#include <unistd.h>
+
+#include "platform.h"
+
+void Platform::SetCurrentThreadName( std::string_view name )
+{
+	// Linux limits thread names to 15 characters plus terminator
+	char threadName[16]{};
+	name.copy( threadName, sizeof( threadName ) - 1 );
+#if defined( __APPLE__ )
+	pthread_setname_np( threadName );
+#else
+	pthread_setname_np( pthread_self(), threadName );
+#endif
+}
+
+bool Platform::EnableConsoleColors()
+{
+	return isatty( STDOUT_FILENO );
+}
+
+uint32_t Platform::GetConsoleWidth()
+{
+	winsize ws{};
+	if ( ioctl( STDOUT_FILENO, TIOCGWINSZ, &ws ) != 0 )
+		return 0;
+	return ws.ws_col;
+}
+
+void Platform::SetInterruptHandler( void ( *handler )() )
+{
+	// Mirror the Win32 console control handler: SIGINT is blocked for every thread
+	// spawned from now on and picked up by a dedicated thread, so the handler is
+	// free to take locks and print.
+	sigset_t set;
+	sigemptyset( &set );
+	sigaddset( &set, SIGINT );
+	pthread_sigmask( SIG_BLOCK, &set, nullptr );
+
+	std::thread( [set, handler]()
+	{
+		int sig;
+		if ( sigwait( &set, &sig ) != 0 )
+			return;
+
+		handler();
+
+		// Terminate the way an unhandled Ctrl+C would
+		signal( SIGINT, SIG_DFL );
+		pthread_sigmask( SIG_UNBLOCK, &set, nullptr );
+		raise( SIGINT );
+	} ).detach();
+}
+
+void Platform::InstallCrashHandler()
+{
+	// Core dumps are configured by the system
+}
+
+void Platform::KeepSystemAwake( bool )
+{
+}
+
+int Platform::StrICmp( const char* a, const char* b ) noexcept
+{
+	return strcasecmp( a, b );
+}
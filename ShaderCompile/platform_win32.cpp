@@ -0,0 +1,142 @@
+//====== Copyright c 1996-2007, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: Win32 implementation of the platform layer.
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#define WIN32_LEAN_AND_MEAN
+#define NOWINRES
+#define NOSERVICE
+#define NOMCX
+#define NOIME
+#define NOMINMAX
+
+#include <windows.h>
+
+#include <DbgHelp.h>
+#include <ctime>
+#include <filesystem>
+#include <string>
+
+#include "platform.h"
+
+#pragma comment( lib, "DbgHelp" )
+
+namespace fs = std::filesystem;
+
+static void ( *s_pfnInterruptHandler )() = nullptr;
+
+static BOOL WINAPI CtrlHandler( DWORD signal )
+{
+	if ( signal == CTRL_C_EVENT && s_pfnInterruptHandler )
+		s_pfnInterruptHandler();
+
+	return FALSE;
+}
+
+static LONG WINAPI ExceptionFilter( _EXCEPTION_POINTERS* pExceptionInfo )
+{
+	constexpr const auto iType = static_cast<MINIDUMP_TYPE>( MiniDumpNormal | MiniDumpWithDataSegs | MiniDumpWithIndirectlyReferencedMemory | MiniDumpWithThreadInfo );
+
+	// create a unique filename for the minidump based on the current time and module name
+	time_t currTime = time( nullptr );
+	struct tm pTime;
+	localtime_s( &pTime, &currTime );
+
+	// strip off the rest of the path from the .exe name
+	char rgchModuleName[MAX_PATH];
+	::GetModuleFileName( nullptr, rgchModuleName, std::size( rgchModuleName ) );
+	char* pch1 = strchr( rgchModuleName, '.' );
+	if ( pch1 )
+		*pch1 = 0;
+	const char* pch = strchr( rgchModuleName, '\\' );
+	if ( pch )
+		// move past the last slash
+		pch++;
+	else
+		pch = "unknown";
+
+	// can't use the normal string functions since we're in tier0
+	char rgchFileName[MAX_PATH];
+	_snprintf_s( rgchFileName, std::size( rgchFileName ),
+		"%s_%d%.2d%2d%.2d%.2d%.2d.mdmp",
+		pch,
+		pTime.tm_year + 1900,	/* Year less 2000 */
+		pTime.tm_mon + 1,		/* month (0 - 11 : 0 = January) */
+		pTime.tm_mday,			/* day of month (1 - 31) */
+		pTime.tm_hour,			/* hour (0 - 23) */
+		pTime.tm_min,			/* minutes (0 - 59) */
+		pTime.tm_sec			/* seconds (0 - 59) */
+		);
+
+	BOOL bMinidumpResult = FALSE;
+	const HANDLE hFile = ::CreateFile( rgchFileName, GENERIC_WRITE, FILE_SHARE_WRITE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr );
+
+	if ( hFile )
+	{
+		// dump the exception information into the file
+		MINIDUMP_EXCEPTION_INFORMATION ExInfo;
+		ExInfo.ThreadId = GetCurrentThreadId();
+		ExInfo.ExceptionPointers = pExceptionInfo;
+		ExInfo.ClientPointers = FALSE;
+
+		bMinidumpResult = MiniDumpWriteDump( ::GetCurrentProcess(), ::GetCurrentProcessId(), hFile, iType, &ExInfo, nullptr, nullptr );
+		CloseHandle( hFile );
+	}
+
+	// mark any failed minidump writes by renaming them
+	if ( !bMinidumpResult )
+	{
+		char rgchFailedFileName[_MAX_PATH];
+		_snprintf_s( rgchFailedFileName, std::size( rgchFailedFileName ), "failed_%s", rgchFileName );
+		std::error_code c;
+		fs::rename( rgchFileName, rgchFailedFileName, c );
+	}
+
+	return EXCEPTION_CONTINUE_SEARCH;
+}
+
+void Platform::SetCurrentThreadName( std::string_view name )
+{
+	const std::wstring workerName( name.begin(), name.end() );
+	SetThreadDescription( GetCurrentThread(), workerName.c_str() );
+}
+
+bool Platform::EnableConsoleColors()
+{
+	const HANDLE console = GetStdHandle( STD_OUTPUT_HANDLE );
+	DWORD mode;
+	GetConsoleMode( console, &mode );
+	return SetConsoleMode( console, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING );
+}
+
+uint32_t Platform::GetConsoleWidth()
+{
+	CONSOLE_SCREEN_BUFFER_INFO csbi;
+	if ( !GetConsoleScreenBufferInfo( GetStdHandle( STD_OUTPUT_HANDLE ), &csbi ) )
+		return 0;
+	return csbi.srWindow.Right - csbi.srWindow.Left + 1;
+}
+
+void Platform::SetInterruptHandler( void ( *handler )() )
+{
+	s_pfnInterruptHandler = handler;
+	SetConsoleCtrlHandler( CtrlHandler, true );
+}
+
+void Platform::InstallCrashHandler()
+{
+	SetUnhandledExceptionFilter( ExceptionFilter );
+}
+
+void Platform::KeepSystemAwake( bool bAwake )
+{
+	SetThreadExecutionState( bAwake ? ES_CONTINUOUS | ES_SYSTEM_REQUIRED : ES_CONTINUOUS );
+}
+
+int Platform::StrICmp( const char* a, const char* b ) noexcept
+{
+	return _stricmp( a, b );
+}
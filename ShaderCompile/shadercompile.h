@@ -0,0 +1,54 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Platform-neutral shader compilation pipeline: combo scheduling,
+//          packaging and .vcs writing.
+//
+//=============================================================================//
+
+#pragma once
+
+#include <chrono>
+#include <compare>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cfgprocessor.h"
+#include "compilerbackend.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+extern std::filesystem::path g_pShaderPath;
+extern Clock::time_point g_flStartTime;
+extern bool g_bVerbose;
+extern bool g_bVerbose2;
+extern bool g_bFastFail;
+extern bool g_bNoCompress; // store combo blocks as is, the engine loads them without LZMA
+extern uint64_t g_nKeepPacked; // bytes of packed static combos a shader keeps in memory before they go to a scratch file
+extern uint64_t g_nMemoryBudget; // bytes of compiled code held before workers stop starting static combos, 0 for no limit
+
+struct ShaderInputData
+{
+	std::string name;
+	std::string_view version;
+	std::string_view target;
+
+	bool operator==(const ShaderInputData&) const = default;
+	std::strong_ordering operator<=>(const ShaderInputData&) const = default;
+};
+
+std::unique_ptr<CfgProcessor::CfgEntryInfo[]> Shared_ParseListOfCompileCommands( std::set<ShaderInputData> files, bool bForce, bool bSpewSkips, bool isCSGO );
+// packThreads of 0 picks a quarter of threads, single-threaded compiles always package in place
+void CompileShaders( std::unique_ptr<CfgProcessor::CfgEntryInfo[]> arrEntries, uint32_t threads, uint32_t packThreads, Compiler::ICompilerBackend& backend, uint32_t flags );
+
+// Interrupts compilation in progress, safe to call from any thread
+void StopCompileShaders();
+
+void PrintCompileErrors( bool skipWarnings );
+
+[[nodiscard]] std::vector<std::string_view> GetCompiledShaderNames();
+[[nodiscard]] size_t GetNumFailedShaders();
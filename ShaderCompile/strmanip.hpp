@@ -12,7 +12,7 @@ struct _Smanip2
 		return _Ostr;
 	}
 
-	void(__cdecl* _Pfun)(std::ostream&, _Arg);
+	void(* _Pfun)(std::ostream&, _Arg);
 	_Arg _Manarg;
 };
 
@@ -0,0 +1,278 @@
+//====== Copyright c 1996-2006, Valve Corporation, All rights reserved. =======//
+//
+// Purpose: Synthetic compiler backend for benchmarking without D3D compiler.
+//
+// $NoKeywords: $
+//
+//=============================================================================//
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "basetypes.h"
+#include "cfgprocessor.h"
+#include "compilerbackend.h"
+
+#include "termcolor/style.hpp"
+#include "termcolors.hpp"
+
+using namespace std::literals;
+
+namespace
+{
+
+class CSyntheticResponse final : public CmdSink::IResponse
+{
+public:
+	CSyntheticResponse( std::vector<uint8_t>&& byteCode, std::string&& listing, bool bSucceeded ) noexcept
+		: m_ByteCode( std::move( byteCode ) ), m_sListing( std::move( listing ) ), m_bSucceeded( bSucceeded )
+	{
+	}
+
+	bool Succeeded() const noexcept override { return m_bSucceeded; }
+	size_t GetResultBufferLen() const override { return m_bSucceeded ? m_ByteCode.size() : 0; }
+	const void* GetResultBuffer() const override { return m_bSucceeded ? m_ByteCode.data() : nullptr; }
+	const char* GetListing() const override { return m_sListing.empty() ? nullptr : m_sListing.c_str(); }
+
+private:
+	std::vector<uint8_t> m_ByteCode;
+	std::string m_sListing;
+	bool m_bSucceeded;
+};
+
+// splitmix64, good enough and trivially reproducible everywhere
+class CComboRandom
+{
+public:
+	explicit CComboRandom( uint64_t nSeed ) noexcept : m_nState( nSeed ) {}
+
+	uint64_t Next() noexcept
+	{
+		uint64_t z = ( m_nState += 0x9e3779b97f4a7c15ULL );
+		z = ( z ^ ( z >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+		z = ( z ^ ( z >> 27 ) ) * 0x94d049bb133111ebULL;
+		return z ^ ( z >> 31 );
+	}
+
+	// [0, 1)
+	double NextUnit() noexcept
+	{
+		return static_cast<double>( Next() >> 11 ) * 0x1.0p-53;
+	}
+
+private:
+	uint64_t m_nState;
+};
+
+static uint64_t HashString( uint64_t nHash, std::string_view str ) noexcept
+{
+	// FNV-1a, terminated so "a" "bc" and "ab" "c" hash differently
+	for ( const char c : str )
+		nHash = ( nHash ^ static_cast<uint8_t>( c ) ) * 0x100000001b3ULL;
+	return ( nHash ^ 0xff ) * 0x100000001b3ULL;
+}
+
+class CSyntheticBackend final : public Compiler::ICompilerBackend
+{
+public:
+	enum class SizeDistribution
+	{
+		Uniform,
+		Log,
+	};
+
+	uint64_t m_nSeed = 0;
+	uint32_t m_nLatencyUs = 0;
+	uint32_t m_nJitterUs = 0;
+	uint32_t m_nMinSize = 512;
+	uint32_t m_nMaxSize = 4096;
+	SizeDistribution m_eDistribution = SizeDistribution::Uniform;
+	double m_flFailRate = 0.0;
+	double m_flWarnRate = 0.0;
+	double m_flDupRate = 0.0;
+
+	std::unique_ptr<CmdSink::IResponse> ExecuteCommand( const CfgProcessor::ComboBuildCommand& pCommand, uint32_t flags ) override;
+
+private:
+	bool IgnoresDefine( std::string_view name, std::string_view value ) const noexcept;
+	void SimulateLatency( CComboRandom& rng ) const;
+	uint32_t PickSize( CComboRandom& rng ) const;
+	static void GenerateByteCode( CComboRandom& rng, uint64_t nHash, std::vector<uint8_t>& byteCode );
+};
+
+std::unique_ptr<CmdSink::IResponse> CSyntheticBackend::ExecuteCommand( const CfgProcessor::ComboBuildCommand& pCommand, uint32_t flags )
+{
+	uint64_t nHash = 0xcbf29ce484222325ULL ^ m_nSeed;
+	nHash = HashString( nHash, pCommand.fileName );
+	nHash = HashString( nHash, pCommand.entryPoint );
+	nHash = HashString( nHash, pCommand.shaderModel );
+	for ( const auto& [name, value] : pCommand.defines )
+	{
+		if ( !IgnoresDefine( name, value ) )
+			nHash = HashString( HashString( nHash, name ), value );
+	}
+	nHash ^= flags;
+
+	CComboRandom rng( nHash );
+
+	// Draw everything in fixed order so the result doesn't depend on the settings used
+	const double flFail = rng.NextUnit();
+	const double flWarn = rng.NextUnit();
+	const uint32_t nSize = PickSize( rng );
+
+	SimulateLatency( rng );
+
+	std::string listing;
+	if ( flWarn < m_flWarnRate )
+		listing.append( pCommand.fileName ).append( "(1,1): warning X3571: synthetic warning\n"sv );
+
+	if ( flFail < m_flFailRate )
+	{
+		listing.append( pCommand.fileName ).append( "(1,1): error X3000: synthetic compile failure\n"sv );
+		return std::unique_ptr<CmdSink::IResponse>{ new( std::nothrow ) CSyntheticResponse( {}, std::move( listing ), false ) };
+	}
+
+	std::vector<uint8_t> byteCode( nSize );
+	GenerateByteCode( rng, nHash, byteCode );
+
+	return std::unique_ptr<CmdSink::IResponse>{ new( std::nothrow ) CSyntheticResponse( std::move( byteCode ), std::move( listing ), true ) };
+}
+
+// Like real shaders where some define values change nothing, the code doesn't depend on a fraction of them.
+// Combos which only differ by those produce the same bytecode, so the static combo dedup gets to see duplicates.
+bool CSyntheticBackend::IgnoresDefine( std::string_view name, std::string_view value ) const noexcept
+{
+	if ( m_flDupRate <= 0.0 )
+		return false;
+
+	// Combo number is different for every combo
+	if ( name == "SHADERCOMBO"sv )
+		return true;
+
+	CComboRandom rng( HashString( HashString( 0x84222325cbf29ce4ULL ^ m_nSeed, name ), value ) );
+	return rng.NextUnit() < m_flDupRate;
+}
+
+void CSyntheticBackend::SimulateLatency( CComboRandom& rng ) const
+{
+	const double flJitter = ( rng.NextUnit() * 2.0 - 1.0 ) * m_nJitterUs;
+	const double flLatency = std::max( 0.0, m_nLatencyUs + flJitter );
+	if ( flLatency <= 0.0 )
+		return;
+
+	// Busy wait, the real compiler keeps the core busy as well
+	const auto end = std::chrono::steady_clock::now() + std::chrono::duration<double, std::micro>( flLatency );
+	while ( std::chrono::steady_clock::now() < end )
+		continue;
+}
+
+uint32_t CSyntheticBackend::PickSize( CComboRandom& rng ) const
+{
+	const double u = rng.NextUnit();
+	if ( m_eDistribution == SizeDistribution::Log )
+	{
+		const double flMin = std::log( static_cast<double>( m_nMinSize ) );
+		const double flMax = std::log( static_cast<double>( m_nMaxSize ) );
+		return std::clamp( static_cast<uint32_t>( std::exp( flMin + u * ( flMax - flMin ) ) ), m_nMinSize, m_nMaxSize );
+	}
+
+	return m_nMinSize + static_cast<uint32_t>( u * ( m_nMaxSize - m_nMinSize + 1.0 ) );
+}
+
+void CSyntheticBackend::GenerateByteCode( CComboRandom& rng, uint64_t nHash, std::vector<uint8_t>& byteCode )
+{
+	// Real bytecode is a stream of tokens from a small vocabulary with lots of repeats,
+	// emulate that so the packaging sees realistic compression ratios.
+	uint32_t vocabulary[64];
+	for ( uint32_t& token : vocabulary )
+		token = static_cast<uint32_t>( rng.Next() );
+
+	const size_t nTokens = byteCode.size() / sizeof( uint32_t );
+	for ( size_t i = 0; i < nTokens; ++i )
+	{
+		const uint64_t r = rng.Next();
+		if ( i > 8 && ( r & 3 ) == 0 )
+			memcpy( &byteCode[i * sizeof( uint32_t )], &byteCode[( i - 1 - ( ( r >> 2 ) & 7 ) ) * sizeof( uint32_t )], sizeof( uint32_t ) );
+		else
+			memcpy( &byteCode[i * sizeof( uint32_t )], &vocabulary[( r >> 8 ) & 63], sizeof( uint32_t ) );
+	}
+
+	// Signature up front, so combos are only identical when the defines the code depends on are
+	memcpy( byteCode.data(), &nHash, std::min( sizeof( nHash ), byteCode.size() ) );
+	for ( size_t i = nTokens * sizeof( uint32_t ); i < byteCode.size(); ++i )
+		byteCode[i] = static_cast<uint8_t>( rng.Next() );
+}
+
+template <typename T>
+static bool ParseNumber( std::string_view value, T& out )
+{
+	const auto res = std::from_chars( value.data(), value.data() + value.size(), out );
+	return res.ec == std::errc{} && res.ptr == value.data() + value.size();
+}
+
+}; // namespace
+
+std::unique_ptr<Compiler::ICompilerBackend> Compiler::CreateSyntheticBackend( std::string_view szConfig )
+{
+	auto pBackend = std::make_unique<CSyntheticBackend>();
+
+	while ( !szConfig.empty() )
+	{
+		const size_t nComma = szConfig.find( ',' );
+		const std::string_view option = szConfig.substr( 0, nComma );
+		szConfig = nComma == std::string_view::npos ? std::string_view{} : szConfig.substr( nComma + 1 );
+		if ( option.empty() )
+			continue;
+
+		const size_t nEq = option.find( '=' );
+		const std::string_view key = option.substr( 0, nEq );
+		const std::string_view value = nEq == std::string_view::npos ? std::string_view{} : option.substr( nEq + 1 );
+
+		bool bValid;
+		if ( key == "seed"sv )
+			bValid = ParseNumber( value, pBackend->m_nSeed );
+		else if ( key == "latency"sv )
+			bValid = ParseNumber( value, pBackend->m_nLatencyUs );
+		else if ( key == "jitter"sv )
+			bValid = ParseNumber( value, pBackend->m_nJitterUs );
+		else if ( key == "size"sv )
+		{
+			const size_t nDash = value.find( '-' );
+			bValid = nDash != std::string_view::npos && ParseNumber( value.substr( 0, nDash ), pBackend->m_nMinSize ) && ParseNumber( value.substr( nDash + 1 ), pBackend->m_nMaxSize )
+				&& pBackend->m_nMinSize > 0 && pBackend->m_nMinSize <= pBackend->m_nMaxSize;
+		}
+		else if ( key == "dist"sv )
+		{
+			bValid = true;
+			if ( value == "uniform"sv )
+				pBackend->m_eDistribution = CSyntheticBackend::SizeDistribution::Uniform;
+			else if ( value == "log"sv )
+				pBackend->m_eDistribution = CSyntheticBackend::SizeDistribution::Log;
+			else
+				bValid = false;
+		}
+		else if ( key == "fail"sv )
+			bValid = ParseNumber( value, pBackend->m_flFailRate ) && pBackend->m_flFailRate >= 0.0 && pBackend->m_flFailRate <= 1.0;
+		else if ( key == "warn"sv )
+			bValid = ParseNumber( value, pBackend->m_flWarnRate ) && pBackend->m_flWarnRate >= 0.0 && pBackend->m_flWarnRate <= 1.0;
+		else if ( key == "dup"sv )
+			bValid = ParseNumber( value, pBackend->m_flDupRate ) && pBackend->m_flDupRate >= 0.0 && pBackend->m_flDupRate <= 1.0;
+		else
+			bValid = false;
+
+		if ( !bValid )
+		{
+			std::cout << clr::red << "Invalid synthetic backend option \""sv << option << "\""sv << clr::reset << std::endl;
+			return nullptr;
+		}
+	}
+
+	return pBackend;
+}
@@ -0,0 +1,38 @@
+# Compiles a fixture shader with the synthetic backend in a fresh directory
+# and compares the MD5 of the .vcs it writes with the expected one.
+#
+# -DSHADERCOMPILE=<exe> -DSHADER=<fixture .fxc> -DVCS=<.vcs name> -DWORK_DIR=<dir>
+# -DSYNTHETIC=<synthetic backend config> -DEXPECTED_MD5=<md5> -DARGS="<extra arguments>"
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+file(COPY "${SHADER}" DESTINATION "${WORK_DIR}")
+get_filename_component(SHADER_NAME "${SHADER}" NAME)
+separate_arguments(EXTRA_ARGS UNIX_COMMAND "${ARGS}")
+
+execute_process(
+    COMMAND "${SHADERCOMPILE}" -ver 30 -shaderpath "${WORK_DIR}" -backend synthetic -synthetic "${SYNTHETIC}" ${EXTRA_ARGS} "${SHADER_NAME}"
+    WORKING_DIRECTORY "${WORK_DIR}"
+    RESULT_VARIABLE RESULT
+    OUTPUT_VARIABLE OUTPUT
+    ERROR_VARIABLE OUTPUT
+    )
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "ShaderCompile ${ARGS} failed with ${RESULT}:\n${OUTPUT}")
+endif()
+
+set(VCS_PATH "${WORK_DIR}/shaders/fxc/${VCS}")
+if(NOT EXISTS "${VCS_PATH}")
+    message(FATAL_ERROR "ShaderCompile ${ARGS} didn't write ${VCS_PATH}:\n${OUTPUT}")
+endif()
+
+# Scratch files of spilled static combos are removed once the shader is written
+file(GLOB SCRATCH_FILES "${WORK_DIR}/shaders/fxc/*.tmp")
+if(SCRATCH_FILES)
+    message(FATAL_ERROR "ShaderCompile ${ARGS} left ${SCRATCH_FILES} behind")
+endif()
+
+file(MD5 "${VCS_PATH}" MD5)
+if(NOT MD5 STREQUAL EXPECTED_MD5)
+    message(FATAL_ERROR "ShaderCompile ${ARGS} wrote ${VCS} with MD5 ${MD5}, expected ${EXPECTED_MD5}")
+endif()